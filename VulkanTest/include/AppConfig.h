@@ -0,0 +1,72 @@
+#ifndef APP_CONFIG_H
+#define APP_CONFIG_H
+
+#include <cstdint>
+#include <string>
+
+enum class TextureCompression : uint32_t {
+	None,
+	Auto, // BC1 for opaque textures, BC7 for ones with alpha
+	BC1,
+	BC3,
+	BC7
+};
+
+struct AppConfig {
+	// How many frames the CPU may record ahead of the GPU. Higher favours throughput, lower favours latency.
+	uint32_t framesInFlight = 2;
+
+	// Renders offscreen without a window, surface or swap chain and prints per-frame timings.
+	bool headless = false;
+	uint32_t headlessFrameCount = 300;
+
+	// Draws are recorded into this many secondary command buffers in parallel, 0 records them inline on the main thread.
+	uint32_t recordThreads = 0;
+
+	// Measures named GPU scopes with timestamp and pipeline statistics queries and prints them on exit.
+	bool gpuProfile = false;
+
+	// Frames captured into a Chrome trace, from startup with --trace or when T is pressed.
+	uint32_t traceFrames = 0;
+	std::string tracePath = "trace.json";
+
+	// Skips submeshes whose bounds are outside the view frustum.
+	bool frustumCulling = true;
+
+	// Culls in a compute shader that writes indirect draws, instead of on the CPU.
+	bool gpuCulling = false;
+
+	// Scene file with the meshes, textures and objects to draw, empty draws the built in model.
+	std::string scenePath;
+
+	// Copies of the built in model laid out on a grid and drawn with one instanced draw per submesh range.
+	uint32_t instanceCount = 1;
+
+	// Sorts triangle clusters of imported meshes front to back after the vertex cache optimization.
+	bool optimizeOverdraw = false;
+
+	// Uploads 16 byte quantized vertices instead of 32 byte float ones.
+	bool packedVertices = false;
+
+	// Block compresses textures on first load and caches them next to the source, when the device samples BC formats.
+	TextureCompression textureCompression = TextureCompression::Auto;
+
+	// Copies uploads on a transfer only or async compute queue family when the device has one.
+	bool transferQueue = true;
+
+	// Decodes textures on a worker thread and streams their levels in, coarsest first, behind a placeholder.
+	bool textureStreaming = true;
+
+	// Imports OBJ files with tinyobjloader instead of the parallel parser.
+	bool tinyObj = false;
+
+	// Compares both OBJ importers on the bundled models and a generated file of this many MiB, then exits.
+	bool objBenchmark = false;
+	uint32_t objBenchmarkMegabytes = 1024;
+
+	static AppConfig fromCommandLine(int argc, char* argv[]);
+
+	static void printUsage();
+};
+
+#endif
@@ -3,14 +3,37 @@
 
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
+#include <chrono>
+#include <deque>
+#include <memory>
 #include <vector>
 #include "VertexData.h"
+#include "Mesh.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "VertexQuantizer.h"
+#include "IndexPacker.h"
+#include "MipChain.h"
+#include "TextureCompressor.h"
+#include "TextureCache.h"
+#include "TextureStreamer.h"
 #include "VDeleter.h"
+#include "MemoryAllocator.h"
+#include "UploadBatcher.h"
+#include "AppConfig.h"
+#include "ThreadPool.h"
+#include "GpuProfiler.h"
+#include "Profiler.h"
+#include "FrustumCuller.h"
+#include "GpuCuller.h"
+#include "InstanceGrid.h"
 #include "Camera.h"
+#include "SceneFile.h"
 
 struct QueueFamilyIndices {
 	int graphicsFamily = -1;
 	int presentFamily = -1;
+	int transferFamily = -1; // the graphics family when there is no better one for uploads
 
 	bool isComplete() {
 		return graphicsFamily >= 0 && presentFamily >= 0;
@@ -23,23 +46,168 @@ struct SwapChainSupportDetails {
 	std::vector<VkPresentModeKHR> presentModes;
 };
 
+// One mesh of the scene and the buffers every object using it is drawn from.
+struct SceneMesh {
+	std::string path;
+	Mesh mesh;
+	MeshCache meshCache;
+	MeshView meshView;
+	IndexLayout indexLayout;
+	VDeleter<VkBuffer> vertexBuffer;
+	VAllocation vertexBufferMemory;
+	VDeleter<VkBuffer> indexBuffer;
+	VAllocation indexBufferMemory;
+
+	// Filled in on the loading worker and printed afterwards, so the reports don't interleave
+	bool cached;
+	double cacheMilliseconds;
+	MeshLoadReport loadReport;
+	MeshOptimizeReport optimizeReport;
+
+	SceneMesh(const VDeleter<VkDevice>& device, MemoryAllocator& allocator, const std::string& path) :
+		path(path),
+		vertexBuffer(device, vkDestroyBuffer),
+		vertexBufferMemory(allocator),
+		indexBuffer(device, vkDestroyBuffer),
+		indexBufferMemory(allocator),
+		cached(false),
+		cacheMilliseconds(0.0) {}
+};
+
+// One texture of the scene with its two descriptor sets.
+struct SceneTexture {
+	std::string path;
+	VDeleter<VkImage> image;
+	VAllocation imageMemory;
+	uint32_t mipLevels;
+	VkFormat format;
+	VDeleter<VkImageView> imageView;
+
+	// While streaming, image is a placeholder and streamedImage fills in from its coarsest level
+	TextureStreamer streamer;
+	VDeleter<VkImage> streamedImage;
+	VAllocation streamedImageMemory;
+	VDeleter<VkImageView> streamedImageView;
+	VDeleter<VkImageView> retiredImageView;
+	uint32_t streamedLevel;
+	bool uploadPending;
+	UploadTicket uploadTicket;
+	bool streamed;
+	uint64_t descriptorSwapFrame;
+	VkDescriptorSet descriptorSet;
+	VkDescriptorSet spareDescriptorSet;
+
+	// Decoded RGBA8 texels when neither streamed nor compressed, freed once uploaded
+	unsigned char* pixels;
+	int width;
+	int height;
+
+	SceneTexture(const VDeleter<VkDevice>& device, MemoryAllocator& allocator, const std::string& path) :
+		path(path),
+		image(device, vkDestroyImage),
+		imageMemory(allocator),
+		mipLevels(1),
+		format(VK_FORMAT_R8G8B8A8_UNORM),
+		imageView(device, vkDestroyImageView),
+		streamedImage(device, vkDestroyImage),
+		streamedImageMemory(allocator),
+		streamedImageView(device, vkDestroyImageView),
+		retiredImageView(device, vkDestroyImageView),
+		streamedLevel(0),
+		uploadPending(false),
+		uploadTicket(0),
+		streamed(false),
+		descriptorSwapFrame(0),
+		descriptorSet(VK_NULL_HANDLE),
+		spareDescriptorSet(VK_NULL_HANDLE),
+		pixels(nullptr),
+		width(0),
+		height(0) {}
+};
+
+// Every object of the scene sharing a mesh and a texture, drawn as instances of one another.
+struct SceneBatch {
+	uint32_t mesh;
+	uint32_t texture;
+	std::vector<InstanceData> instances;
+	std::vector<Submesh> instancedSubmeshes;
+	MeshView cullView;
+	FrustumCuller frustumCuller;
+	GpuCuller gpuCuller;
+	std::vector<uint32_t> visibleSubmeshes;
+	VDeleter<VkBuffer> instanceBuffer;
+	VAllocation instanceBufferMemory;
+
+	SceneBatch(const VDeleter<VkDevice>& device, MemoryAllocator& allocator, uint32_t mesh, uint32_t texture) :
+		mesh(mesh),
+		texture(texture),
+		gpuCuller(device, allocator),
+		instanceBuffer(device, vkDestroyBuffer),
+		instanceBufferMemory(allocator) {}
+};
+
+// A visible submesh of a batch, drawn once per instance.
+struct SceneDraw {
+	uint32_t batch;
+	uint32_t submesh;
+};
+
+struct FrameResources {
+	VDeleter<VkCommandPool> commandPool;
+	VkCommandBuffer commandBuffer;
+	VDeleter<VkSemaphore> imageAvailableSemaphore;
+	VDeleter<VkSemaphore> renderFinishedSemaphore;
+	VDeleter<VkFence> inFlightFence;
+	int64_t timedFrame;
+
+	// One pool per recording thread, each only touched by the task recording that secondary buffer
+	std::vector<VDeleter<VkCommandPool>> secondaryCommandPools;
+	std::vector<VkCommandBuffer> secondaryCommandBuffers;
+
+	FrameResources(const VDeleter<VkDevice>& device) :
+		commandPool(device, vkDestroyCommandPool),
+		commandBuffer(VK_NULL_HANDLE),
+		imageAvailableSemaphore(device, vkDestroySemaphore),
+		renderFinishedSemaphore(device, vkDestroySemaphore),
+		inFlightFence(device, vkDestroyFence),
+		timedFrame(-1) {}
+};
+
+// A replaced swap chain, kept until the frames that presented from it have finished
+struct RetiredSwapChain {
+	VDeleter<VkSwapchainKHR> swapChain;
+	uint64_t retireFrame;
+
+	RetiredSwapChain(const VDeleter<VkDevice>& device, uint64_t retireFrame) :
+		swapChain(device, vkDestroySwapchainKHR),
+		retireFrame(retireFrame) {}
+};
+
 class Application
 {
 public:
-	Application();
+	Application(const AppConfig& config);
 
 	void run();
 
 private:
+	const AppConfig config;
 	GLFWwindow* window;
 	VDeleter<VkInstance> instance;
 	VDeleter<VkDebugReportCallbackEXT> debugReportCallback;
 	VkPhysicalDevice physicalDevice;
+	VkPhysicalDeviceFeatures enabledFeatures;
+	bool drawIndirectCountEnabled;
 	VDeleter<VkDevice> device;
+	MemoryAllocator allocator;
+	UploadBatcher uploadBatcher;
+	GpuProfiler gpuProfiler;
 	VDeleter<VkSurfaceKHR> surface;
 	VDeleter<VkSwapchainKHR> swapChain;
+	std::deque<RetiredSwapChain> retiredSwapChains;
 	VkQueue graphicsQueue;
 	VkQueue presentQueue;
+	VkQueue transferQueue;
 	const std::vector<const char*> validationLayers;
 	const std::vector<const char*> deviceExtensions;
 	std::vector<VkImage> swapChainImages;
@@ -49,33 +217,45 @@ private:
 	std::vector<VDeleter<VkImageView>> swapChainImageViews;
 	VDeleter<VkDescriptorSetLayout> descriptorSetLayout;
 	VDeleter<VkPipelineLayout> pipelineLayout;
+	VDeleter<VkPipelineCache> pipelineCache;
+	bool pipelineCacheWarm;
 	VDeleter<VkRenderPass> renderPass;
 	VDeleter<VkPipeline> graphicsPipelineSolid;
 	VDeleter<VkPipeline> graphicsPipelineWireframe;
 	std::vector<VDeleter<VkFramebuffer>> swapChainFramebuffers;
-	VDeleter<VkCommandPool> commandPool;
-	std::vector<VkCommandBuffer> commandBuffers;
-	VDeleter<VkSemaphore> imageAvailableSemaphore;
-	VDeleter<VkSemaphore> renderFinishedSemaphore;
-	VDeleter<VkImage> textureImage;
-	VDeleter<VkDeviceMemory> textureImageMemory;
-	std::vector<Vertex> vertices;
-	std::vector<uint32_t> indices;
-	VDeleter<VkBuffer> vertexBuffer;
-	VDeleter<VkDeviceMemory> vertexBufferMemory;
-	VDeleter<VkBuffer> indexBuffer;
-	VDeleter<VkDeviceMemory> indexBufferMemory;
-	VDeleter<VkBuffer> uniformStagingBuffer;
-	VDeleter<VkDeviceMemory> uniformStagingBufferMemory;
+	std::vector<FrameResources> frames;
+	std::vector<VkFence> imagesInFlight;
+	uint32_t currentFrame;
+	uint64_t submittedFrames;
+	UploadTicket swapChainUploads;
+	SceneDescription scene;
+	std::vector<std::unique_ptr<SceneMesh>> meshes;
+	std::vector<std::unique_ptr<SceneTexture>> textures;
+	std::vector<std::unique_ptr<SceneBatch>> batches;
+	// The CPU culled submeshes of this frame, grouped by batch
+	std::vector<SceneDraw> drawList;
+	uint32_t sceneSubmeshCount;
+	uint32_t sceneInstanceCount;
+	bool gpuCulling;
+	std::chrono::steady_clock::time_point streamStart;
+	glm::mat4 modelViewProjection;
+	uint64_t visibleSubmeshTotal;
+	uint64_t culledFrameCount;
 	VDeleter<VkBuffer> uniformBuffer;
-	VDeleter<VkDeviceMemory> uniformBufferMemory;
+	VAllocation uniformBufferMemory;
+	char* uniformBufferMapped;
+	VkDeviceSize uniformSliceSize;
 	VDeleter<VkDescriptorPool> descriptorPool;
-	VkDescriptorSet descriptorSet;
-	VDeleter<VkImageView> textureImageView;
+	uint64_t frameCounter;
 	VDeleter<VkSampler> textureSampler;
 	VDeleter<VkImage> depthImage;
-	VDeleter<VkDeviceMemory> depthImageMemory;
+	VAllocation depthImageMemory;
 	VDeleter<VkImageView> depthImageView;
+	VDeleter<VkImage> offscreenImage;
+	VAllocation offscreenImageMemory;
+	VDeleter<VkQueryPool> timestampQueryPool;
+	float timestampPeriod;
+	std::vector<double> gpuFrameTimes;
 
 	Camera camera;
 	glm::vec3 rotation = glm::vec3();
@@ -105,8 +285,12 @@ private:
 
 	void createLogicalDevice();
 
+	void createMemoryAllocator();
+
 	void createSwapChain();
 
+	void createOffscreenTarget();
+
 	void recreateSwapChain();
 
 	void createImageViews();
@@ -115,40 +299,100 @@ private:
 
 	void createDescriptorSetLayout();
 
+	void createPipelineCache();
+
+	void savePipelineCache();
+
 	void createGraphicsPipeline();
 
 	void createFramebuffers();
 
 	void createCommandPool();
 
+	void createUploadBatcher();
+
+	void createGpuProfiler();
+
 	void createDepthResources();
 
-	void createTextureImage();
+	// Reads the scene file, or makes a scene of the built in model, then loads its meshes and textures in parallel.
+	void loadScene();
+
+	// Runs on a pool worker, maps the mesh cache or imports, optimizes and caches the OBJ file.
+	void loadMesh(SceneMesh& sceneMesh);
+
+	void createTextureImages();
+
+	void createTextureImage(SceneTexture& texture);
 
-	void createTextureImageView();
+	// Uploads the BC compressed mip chain the texture's streamer loaded.
+	void createCompressedTextureImage(SceneTexture& texture);
+
+	// One grey texel bound until the streamed texture has levels resident.
+	void createPlaceholderTexture(SceneTexture& texture);
+
+	// Called once per frame after its fence wait. Uploads the next streamed levels of every texture within one
+	// per-frame budget and, once an upload completes, points the texture's spare descriptor set at a view including them.
+	void updateTextureStreaming();
+
+	// Copies levels [firstLevel, firstLevel + levelCount) through a staging buffer and makes them shader readable.
+	void uploadTextureLevels(VkImage image, const TextureMips& mips, uint32_t firstLevel, uint32_t levelCount);
 
 	void createTextureSampler();
 
-	void loadModel();
+	void createMeshBuffers();
+
+	void createVertexBuffer(SceneMesh& sceneMesh);
 
-	void createVertexBuffer();
+	void createIndexBuffer(SceneMesh& sceneMesh);
 
-	void createIndexBuffer();
+	// Groups the scene's objects into one instanced batch per mesh and texture pair.
+	void createBatches();
+
+	void createInstanceBuffer(SceneBatch& batch);
+
+	void createGpuCullers();
 
 	void createUniformBuffer();
 
 	void createCommandBuffers();
 
+	void recordCommandBuffer(FrameResources& frame, uint32_t imageIndex);
+
+	void recordSecondaryCommandBuffers(FrameResources& frame, uint32_t imageIndex);
+
+	void bindDrawState(VkCommandBuffer commandBuffer);
+
+	// Binds the batch's mesh, instances, texture and uniform slice.
+	void bindBatch(VkCommandBuffer commandBuffer, const SceneBatch& batch);
+
+	void recordDraws(VkCommandBuffer commandBuffer, const SceneDraw* draws, uint32_t drawCount);
+
+	void cullSubmeshes();
+
+	std::string cullingStats() const;
+
 	void createSemaphores();
 
-	void updateUniformBuffer();
+	void createFences();
+
+	void createTimestampQueries();
+
+	void readTimestampQueries(FrameResources& frame);
+
+	void updateUniformBuffer(uint32_t frameIndex);
 
 	void createDescriptorPool();
 
-	void createDescriptorSet();
+	void createDescriptorSets();
+
+	// Binds the uniform buffer and the texture view to one of the two descriptor sets.
+	void writeDescriptorSet(VkDescriptorSet set, VkImageView imageView);
 
 	bool drawFrame();
 
+	void drawOffscreenFrame(uint32_t frameNumber);
+
 	std::vector<const char*> getRequiredExtensions();
 
 	bool checkValidationLayerSupport();
@@ -171,23 +415,22 @@ private:
 
 	void mainLoop();
 
-	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VDeleter<VkBuffer>& buffer, VDeleter<VkDeviceMemory>& bufferMemory);
+	void headlessLoop();
 
-	void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VDeleter<VkImage>& image, VDeleter<VkDeviceMemory>& imageMemory);
+	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VDeleter<VkBuffer>& buffer, VAllocation& bufferMemory);
 
-	void transitionImageLayout(VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout);
+	void createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VDeleter<VkImage>& image, VAllocation& imageMemory, uint32_t arrayLayers = 1);
 
-	void createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, VDeleter<VkImageView>& imageView);
+	void transitionImageLayout(VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels, uint32_t layerCount = 1, uint32_t baseMipLevel = 0);
 
-	void copyImage(VkImage srcImage, VkImage dstImage, uint32_t width, uint32_t height);
+	void createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels, VDeleter<VkImageView>& imageView, uint32_t baseMipLevel = 0);
 
-	void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
-
-	VkCommandBuffer beginSingleTimeCommands();
+	// Copies every level of every layer in one command, layers stored back to back layerStride bytes apart.
+	void copyBufferToImage(VkBuffer buffer, VkImage image, const std::vector<MipLevel>& levels, uint32_t layerCount = 1, VkDeviceSize layerStride = 0, uint32_t baseMipLevel = 0);
 
-	void endSingleTimeCommands(VkCommandBuffer commandBuffer);
+	void generateMipmaps(VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels);
 
-	uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+	void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
 
 	VkFormat findDepthFormat();
 
@@ -0,0 +1,44 @@
+#ifndef FRUSTUM_CULLER_H
+#define FRUSTUM_CULLER_H
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Mesh.h"
+
+struct Frustum {
+	// Normalized planes, xyz points inwards, a point p is inside when dot(xyz, p) + w >= 0
+	glm::vec4 planes[6];
+
+	// Planes of a clip space with 0..1 depth, in the space the matrix transforms from.
+	static Frustum fromMatrix(const glm::mat4& matrix);
+
+	// Planes every bound is inside of, for drawing without culling.
+	static Frustum unbounded();
+};
+
+// Tests submesh bounds against a frustum: bounding spheres four at a time with SSE, then
+// the boxes of the spheres that survive.
+class FrustumCuller
+{
+public:
+	void build(const MeshView& mesh);
+
+	// Fills visible with the indices of the submeshes that intersect the frustum.
+	void cull(const Frustum& frustum, std::vector<uint32_t>& visible) const;
+
+	size_t size() const
+	{
+		return boxes.size();
+	}
+
+private:
+	// Sphere centers and radii split into arrays padded to a multiple of four
+	std::vector<float> centerX;
+	std::vector<float> centerY;
+	std::vector<float> centerZ;
+	std::vector<float> radius;
+	std::vector<Bounds> boxes;
+};
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef GPU_CULLER_H
+#define GPU_CULLER_H
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include "VDeleter.h"
+#include "MemoryAllocator.h"
+#include "UploadBatcher.h"
+#include "FrustumCuller.h"
+#include "Mesh.h"
+#include "IndexPacker.h"
+
+// Culls submeshes in a compute shader that writes the indirect draw commands of the render
+// pass, so recording a frame costs the same few commands however many submeshes there are.
+// With VK_AMD_draw_indirect_count the visible draws are compacted and their count read by
+// the GPU, otherwise every submesh keeps its command and culled ones draw no instances.
+class GpuCuller
+{
+public:
+	GpuCuller(const VDeleter<VkDevice>& device, MemoryAllocator& allocator);
+
+	// Every index chunk of a visible submesh is drawn instanceCount times, the submesh bounds have to cover all the instances.
+	// drawIndexedIndirectCount is null when the device lacks VK_AMD_draw_indirect_count.
+	void init(const MeshView& mesh, const IndexLayout& indexLayout, uint32_t instanceCount, UploadBatcher& uploadBatcher, VkPipelineCache pipelineCache,
+		PFN_vkCmdDrawIndexedIndirectCountAMD drawIndexedIndirectCount, bool multiDrawIndirect);
+
+	bool isEnabled() const
+	{
+		return (VkPipeline)pipeline != VK_NULL_HANDLE;
+	}
+
+	// Dispatches the culling shader, must be recorded outside of the render pass.
+	void recordCull(VkCommandBuffer commandBuffer, const Frustum& frustum);
+
+	// Draws the commands written by recordCull, with the graphics pipeline, vertex and index buffers bound.
+	void recordDraws(VkCommandBuffer commandBuffer);
+
+private:
+	static const uint32_t WORKGROUP_SIZE = 64;
+
+	// std430 layouts of cull.comp, one entry per index chunk with the bounds of its submesh
+	struct SubmeshBounds {
+		glm::vec4 sphere;
+		glm::vec4 boxMin;
+		glm::vec4 boxMax;
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		int32_t vertexOffset;
+		uint32_t pad;
+	};
+
+	struct CullConstants {
+		glm::vec4 planes[6];
+		uint32_t drawCount;
+		uint32_t instanceCount;
+		uint32_t compact;
+	};
+
+	const VDeleter<VkDevice>& device;
+	MemoryAllocator& allocator;
+	uint32_t drawCount;
+	uint32_t instanceCount;
+	PFN_vkCmdDrawIndexedIndirectCountAMD drawIndexedIndirectCount;
+	bool multiDrawIndirect;
+	VDeleter<VkBuffer> submeshBuffer;
+	VAllocation submeshBufferMemory;
+	VDeleter<VkBuffer> drawBuffer;
+	VAllocation drawBufferMemory;
+	VDeleter<VkBuffer> countBuffer;
+	VAllocation countBufferMemory;
+	VDeleter<VkDescriptorSetLayout> descriptorSetLayout;
+	VDeleter<VkDescriptorPool> descriptorPool;
+	VkDescriptorSet descriptorSet;
+	VDeleter<VkPipelineLayout> pipelineLayout;
+	VDeleter<VkPipeline> pipeline;
+
+	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VDeleter<VkBuffer>& buffer, VAllocation& bufferMemory);
+
+	void createDescriptorSet();
+
+	void createPipeline(VkPipelineCache pipelineCache);
+};
+
+#endif
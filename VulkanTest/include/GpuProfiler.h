@@ -0,0 +1,102 @@
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "VDeleter.h"
+
+struct GpuScopeStats {
+	std::string name;
+	uint32_t sampleCount = 0;
+	double minMilliseconds = 0.0;
+	double avgMilliseconds = 0.0;
+	double p99Milliseconds = 0.0;
+
+	// Averages over the same window, zero when pipeline statistics are unavailable
+	double vertexInvocations = 0.0;
+	double clippingPrimitives = 0.0;
+	double fragmentInvocations = 0.0;
+};
+
+// Named GPU scopes measured with timestamp and pipeline statistics queries. Each frame
+// writes its queries into its own slot, and a slot is only read back when it comes
+// around again, so results arrive a few frames late but reading them never waits.
+class GpuProfiler
+{
+public:
+	static const uint32_t NO_SCOPE = 0xffffffffu;
+
+	// Secondary command buffers executed inside a scope have to inherit at least these
+	static const VkQueryPipelineStatisticFlags PIPELINE_STATISTICS =
+		VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+		VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+		VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+	GpuProfiler(const VDeleter<VkDevice>& device);
+
+	// frameSlots should exceed the number of frames in flight so a slot is complete before it is read.
+	void init(VkPhysicalDevice physicalDevice, uint32_t queueFamilyIndex, uint32_t frameSlots, bool pipelineStatistics);
+
+	bool isEnabled() const
+	{
+		return (VkQueryPool)timestampPool != VK_NULL_HANDLE || (VkQueryPool)statisticsPool != VK_NULL_HANDLE;
+	}
+
+	// Reads back the oldest slot and starts recording scopes into it.
+	void beginFrame();
+
+	// Scopes must begin and end outside of render passes, since their queries are reset in place.
+	// Statistics can be left out for scopes that execute secondary command buffers without inheritedQueries.
+	uint32_t beginScope(VkCommandBuffer commandBuffer, const char* name, bool statistics = true);
+
+	void endScope(VkCommandBuffer commandBuffer, uint32_t scope);
+
+	// Reads every slot, only valid once the device is idle.
+	void flush();
+
+	std::vector<GpuScopeStats> getStats() const;
+
+	void printStats(std::ostream& out) const;
+
+private:
+	static const uint32_t MAX_SCOPES_PER_SLOT = 64;
+	static const uint32_t HISTORY_SIZE = 256;
+
+	struct Scope {
+		const char* name;
+		bool statistics;
+	};
+
+	struct Slot {
+		std::vector<Scope> scopes;
+	};
+
+	struct Sample {
+		double milliseconds;
+		bool hasStatistics;
+		uint64_t statistics[3];
+	};
+
+	struct History {
+		std::vector<Sample> samples;
+		uint32_t next = 0;
+	};
+
+	const VDeleter<VkDevice>& device;
+	VDeleter<VkQueryPool> timestampPool;
+	VDeleter<VkQueryPool> statisticsPool;
+	double timestampPeriod;
+	uint64_t timestampMask;
+	std::vector<Slot> slots;
+	uint32_t currentSlot;
+	uint32_t droppedScopes;
+	std::map<std::string, History> histories;
+
+	void collect(uint32_t slotIndex);
+};
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef INDEX_PACKER_H
+#define INDEX_PACKER_H
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <vector>
+#include "Mesh.h"
+
+// Index range drawn with one vertexOffset, its indices are stored relative to that offset.
+struct IndexChunk {
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	int32_t vertexOffset;
+};
+
+struct IndexLayout {
+	VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+	std::vector<IndexChunk> chunks;
+	// The chunks of submesh i are [submeshChunks[i], submeshChunks[i + 1])
+	std::vector<uint32_t> submeshChunks;
+
+	size_t indexSize() const
+	{
+		return indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+	}
+};
+
+// Chooses the narrowest index type a mesh can be drawn with. Meshes with more than 64K
+// vertices still get 16-bit indices when their submeshes split into chunks that each
+// reference less than 64K consecutive vertices, which the vertex fetch order of the mesh
+// optimizer makes likely. Indices keep their positions, only their values change.
+class IndexPacker
+{
+public:
+	static const uint32_t MAX_CHUNK_VERTICES = 65536;
+
+	static IndexLayout plan(const MeshView& mesh);
+
+	// Writes mesh.indexCount indices of layout.indexSize() bytes each.
+	static void write(const MeshView& mesh, const IndexLayout& layout, void* out);
+};
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef INSTANCE_GRID_H
+#define INSTANCE_GRID_H
+
+#include <cstdint>
+#include <vector>
+#include "Mesh.h"
+
+class InstanceGrid
+{
+public:
+	// Lays count copies of a mesh out on a square grid in the XZ plane, centered on the origin.
+	static std::vector<InstanceData> build(uint32_t count, const Bounds& meshBounds);
+
+	// Submeshes whose bounds cover every instance of them, so culling them culls all their instances at once.
+	static std::vector<Submesh> coveringSubmeshes(const MeshView& mesh, const std::vector<InstanceData>& instances);
+
+	static Bounds transformBounds(const Bounds& bounds, const glm::mat4& transform);
+};
+
+#endif
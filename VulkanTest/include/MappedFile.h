@@ -0,0 +1,48 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <string>
+#include <cstddef>
+
+// Read-only memory mapping of a whole file.
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// Returns false if the file does not exist or cannot be mapped.
+	bool open(const std::string& path);
+
+	void close();
+
+	const char* data() const
+	{
+		return mapped;
+	}
+
+	size_t size() const
+	{
+		return length;
+	}
+
+	bool isOpen() const
+	{
+		return mapped != nullptr;
+	}
+
+private:
+	const char* mapped;
+	size_t length;
+#ifdef _WIN32
+	void* file;
+	void* mapping;
+#else
+	int file;
+#endif
+};
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef MEMORY_ALLOCATOR_H
+#define MEMORY_ALLOCATOR_H
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include "VDeleter.h"
+
+// Kind of resource bound to a suballocation. Linear (buffers, linear images) and
+// optimal resources must not share a bufferImageGranularity page.
+enum class AllocationType {
+	Free,
+	Buffer,
+	ImageLinear,
+	ImageOptimal
+};
+
+struct MemoryBlock;
+
+struct MemoryAllocation {
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;
+	uint32_t memoryTypeIndex = 0;
+	MemoryBlock* block = nullptr;
+};
+
+struct HeapStats {
+	uint32_t blockCount = 0;
+	uint32_t allocationCount = 0;
+	uint32_t freeRangeCount = 0;
+	VkDeviceSize bytesAllocated = 0;
+	VkDeviceSize bytesUsed = 0;
+	VkDeviceSize largestFreeRange = 0;
+
+	// 0 when all free space is one contiguous range, approaching 1 as it gets split up.
+	float fragmentation() const;
+};
+
+struct AllocatorStats {
+	uint32_t deviceAllocationCount = 0;
+	uint32_t maxDeviceAllocationCount = 0;
+	std::vector<HeapStats> heaps;
+};
+
+class MemoryAllocator
+{
+public:
+	MemoryAllocator(const VDeleter<VkDevice>& device);
+	~MemoryAllocator();
+
+	void init(VkPhysicalDevice physicalDevice, VkDeviceSize preferredBlockSize = 64 * 1024 * 1024);
+
+	void destroy();
+
+	MemoryAllocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, AllocationType type);
+
+	void free(MemoryAllocation& allocation);
+
+	// Host visible blocks stay mapped for their whole lifetime, so this is just a pointer offset.
+	void* map(const MemoryAllocation& allocation);
+
+	uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
+
+	AllocatorStats getStats();
+
+	void printStats(std::ostream& out);
+
+private:
+	const VDeleter<VkDevice>& device;
+	VkPhysicalDeviceMemoryProperties memProperties;
+	VkDeviceSize bufferImageGranularity;
+	uint32_t maxDeviceAllocationCount;
+	uint32_t deviceAllocationCount;
+	std::vector<VkDeviceSize> blockSizes;
+	std::vector<std::vector<std::unique_ptr<MemoryBlock>>> blocks;
+	std::mutex mutex;
+
+	MemoryBlock* createBlock(uint32_t memoryTypeIndex, VkDeviceSize size, bool dedicated);
+
+	void destroyBlock(MemoryBlock* block);
+};
+
+// Owns a single MemoryAllocation the same way VDeleter owns a Vulkan handle.
+class VAllocation {
+public:
+	VAllocation(MemoryAllocator& allocator) : allocator(&allocator) {}
+
+	// Copies only bind to the same allocator, they never share the allocation.
+	VAllocation(const VAllocation& other) : allocator(other.allocator) {}
+
+	~VAllocation() {
+		cleanup();
+	}
+
+	VAllocation& operator=(const VAllocation&) = delete;
+
+	MemoryAllocation* replace() {
+		cleanup();
+		return &allocation;
+	}
+
+	MemoryAllocation release() {
+		MemoryAllocation released = allocation;
+		allocation = MemoryAllocation();
+		return released;
+	}
+
+	const MemoryAllocation& get() const {
+		return allocation;
+	}
+
+	operator VkDeviceMemory() const {
+		return allocation.memory;
+	}
+
+	VkDeviceSize offset() const {
+		return allocation.offset;
+	}
+
+	void* map() const {
+		return allocator->map(allocation);
+	}
+
+private:
+	MemoryAllocator* allocator;
+	MemoryAllocation allocation;
+
+	void cleanup() {
+		if (allocation.memory != VK_NULL_HANDLE) {
+			allocator->free(allocation);
+		}
+		allocation = MemoryAllocation();
+	}
+};
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <vector>
+#include <string>
+#include "VertexData.h"
+
+struct Bounds {
+	glm::vec3 min;
+	glm::vec3 max;
+};
+
+// Index range drawn on its own, one per OBJ shape.
+struct Submesh {
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	Bounds bounds;
+	glm::vec4 sphere; // center and radius
+};
+
+// Non-owning view of mesh data, either in a Mesh or in a mapped mesh cache.
+struct MeshView {
+	const Vertex* vertices = nullptr;
+	size_t vertexCount = 0;
+	const uint32_t* indices = nullptr;
+	size_t indexCount = 0;
+	const Submesh* submeshes = nullptr;
+	size_t submeshCount = 0;
+	Bounds bounds = {};
+};
+
+struct Mesh {
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	std::vector<Submesh> submeshes;
+	Bounds bounds = {};
+
+	MeshView view() const;
+};
+
+// Options a mesh was imported with, kept in mesh caches so changing them rebuilds the cache.
+enum MeshImportFlags : uint32_t {
+	MESH_IMPORT_OVERDRAW = 1 << 0,
+};
+
+struct MeshLoadReport {
+	size_t sourceVertexCount = 0;
+	size_t uniqueVertexCount = 0;
+	double parseMilliseconds = 0.0;
+	double buildMilliseconds = 0.0;
+
+	size_t bytesSaved() const
+	{
+		return (sourceVertexCount - uniqueVertexCount) * sizeof(Vertex);
+	}
+
+	void print(const std::string& path) const;
+};
+
+enum class ObjImporter {
+	TinyObj,
+	Parallel // ObjParser, chunks of the file parsed on the shared thread pool
+};
+
+class MeshLoader
+{
+public:
+	static Mesh loadObj(const std::string& path, MeshLoadReport& report, ObjImporter importer = ObjImporter::Parallel);
+
+	static Bounds computeBounds(const std::vector<Vertex>& vertices);
+
+	// Fills in the bounds and bounding sphere of the submesh's index range.
+	static void computeSubmeshBounds(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, Submesh& submesh);
+};
+
+#endif
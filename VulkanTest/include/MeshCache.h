@@ -0,0 +1,31 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <string>
+#include "Mesh.h"
+#include "MappedFile.h"
+
+// Binary mesh file holding interleaved vertices, indices and bounds, tagged with the
+// hash and size of the source it was built from and the options it was imported with. Opened by memory mapping, so the
+// arrays are read straight from the file without any parsing.
+class MeshCache
+{
+public:
+	// Fails if the cache is missing, malformed or was built from a different source or with other import flags.
+	bool open(const std::string& path, uint64_t sourceHash, uint64_t sourceSize, uint32_t importFlags);
+
+	void close();
+
+	MeshView view() const
+	{
+		return meshView;
+	}
+
+	static bool write(const std::string& path, uint64_t sourceHash, uint64_t sourceSize, uint32_t importFlags, const MeshView& mesh);
+
+private:
+	MappedFile file;
+	MeshView meshView;
+};
+
+#endif
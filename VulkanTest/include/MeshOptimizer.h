@@ -0,0 +1,47 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <cstdint>
+#include <string>
+#include "Mesh.h"
+
+// Post-transform cache efficiency of an index buffer, simulated with a FIFO cache.
+struct VertexCacheStats {
+	double acmr = 0.0; // transformed vertices per triangle, 0.5 at best and 3 at worst
+	double atvr = 0.0; // transformed vertices per referenced vertex, 1 at best
+};
+
+struct MeshOptimizeReport {
+	VertexCacheStats before;
+	VertexCacheStats after;
+	uint32_t overdrawClusters = 0;
+	double milliseconds = 0.0;
+
+	void print(const std::string& path) const;
+};
+
+// Import time reordering of a mesh for the GPU. Triangles are reordered within each submesh
+// so the post-transform cache hits more often, optionally followed by sorting clusters of
+// them front to back to help early depth rejection, then vertices are renumbered in the
+// order the index buffer first fetches them.
+class MeshOptimizer
+{
+public:
+	static const uint32_t ANALYSIS_CACHE_SIZE = 16;
+
+	static void optimize(Mesh& mesh, bool overdraw, MeshOptimizeReport& report);
+
+	// Forsyth's linear-speed vertex cache optimization of one index range.
+	static void optimizeVertexCache(uint32_t* indices, size_t indexCount);
+
+	// Splits a cache optimized index range where the cache starts cold and sorts the resulting
+	// clusters so those facing away from the mesh center are drawn first. Returns the cluster count.
+	static uint32_t optimizeOverdraw(uint32_t* indices, size_t indexCount, const Vertex* vertices);
+
+	// Renumbers vertices in order of first use, unreferenced vertices are dropped.
+	static void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+
+	static VertexCacheStats analyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize = ANALYSIS_CACHE_SIZE);
+};
+
+#endif
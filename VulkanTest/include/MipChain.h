@@ -0,0 +1,32 @@
+#ifndef MIP_CHAIN_H
+#define MIP_CHAIN_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+struct MipLevel {
+	uint32_t width;
+	uint32_t height;
+	size_t offset;
+	size_t size;
+};
+
+// CPU generation of RGBA8 mip chains, used when the device cannot blit the texture format.
+class MipChain
+{
+public:
+	// Number of levels down to 1x1.
+	static uint32_t levelCount(uint32_t width, uint32_t height);
+
+	// Offsets and sizes of each level when all of them are stored back to back.
+	static std::vector<MipLevel> layout(uint32_t width, uint32_t height, uint32_t levels);
+
+	// Fills levels 1..n of a chain whose level 0 is already in place.
+	static void generate(uint8_t* chain, const std::vector<MipLevel>& levels);
+
+	// 2x2 box filter from one level to the next, edges are clamped for odd sizes.
+	static void downsample(const uint8_t* src, uint32_t srcWidth, uint32_t srcHeight, uint8_t* dst);
+};
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef OBJ_BENCHMARK_H
+#define OBJ_BENCHMARK_H
+
+#include <cstdint>
+
+// Loads the bundled models and a generated OBJ of the given size with both importers,
+// printing parse and indexing times and checking both produce the same mesh.
+class ObjBenchmark
+{
+public:
+	// Returns false when the importers disagree on any model. A size of 0 skips the generated file.
+	static bool run(uint32_t syntheticMegabytes);
+};
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef OBJ_PARSER_H
+#define OBJ_PARSER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "ThreadPool.h"
+
+// Zero based attribute indices of one face corner, -1 when the corner has no such attribute.
+struct ObjIndex {
+	int32_t vertex;
+	int32_t normal;
+	int32_t texcoord;
+};
+
+// Triangulated faces between two 'o' or 'g' lines.
+struct ObjShape {
+	std::string name;
+	std::vector<ObjIndex> indices;
+};
+
+struct ObjData {
+	std::vector<float> positions; // xyz
+	std::vector<float> normals;   // xyz
+	std::vector<float> texcoords; // uv
+	std::vector<ObjShape> shapes;
+};
+
+// Wavefront OBJ parser that maps the file, splits it into line aligned chunks and parses
+// them in parallel. Each chunk collects its own attributes and faces, which are then
+// merged with their indices rebased onto the whole file. Only geometry is read: v, vt,
+// vn, f, o and g lines, polygons are fan triangulated and shapes split like tinyobj's.
+class ObjParser
+{
+public:
+	static ObjData load(const std::string& path, ThreadPool& pool);
+
+	static ObjData parse(const char* data, size_t size, ThreadPool& pool);
+
+	// Writes a tiled grid mesh of about targetBytes, some tiles using relative indices.
+	static bool writeSynthetic(const std::string& path, uint64_t targetBytes);
+};
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Scoped CPU zones recorded into per-thread buffers and written out as a Chrome trace
+// (chrome://tracing or Perfetto). When no capture is running a zone costs one branch.
+class Profiler
+{
+public:
+	static bool isEnabled()
+	{
+		return enabled.load(std::memory_order_relaxed);
+	}
+
+	// Starts recording and writes the trace to path after frameCount calls to frameMark().
+	static void beginCapture(uint32_t frameCount, const std::string& path);
+
+	// Called once per frame from the main thread, when no other thread is inside a zone.
+	static void frameMark();
+
+	// Names the calling thread in the trace.
+	static void setThreadName(const char* name);
+
+	static uint64_t now();
+
+	static void record(const char* name, uint64_t start, uint64_t end);
+
+private:
+	static std::atomic<bool> enabled;
+
+	static void endCapture();
+};
+
+class ProfileZone
+{
+public:
+	explicit ProfileZone(const char* zoneName) :
+		name(Profiler::isEnabled() ? zoneName : nullptr),
+		start(name != nullptr ? Profiler::now() : 0)
+	{
+	}
+
+	~ProfileZone()
+	{
+		if (name != nullptr) {
+			Profiler::record(name, start, Profiler::now());
+		}
+	}
+
+	ProfileZone(const ProfileZone&) = delete;
+	ProfileZone& operator=(const ProfileZone&) = delete;
+
+private:
+	const char* name;
+	uint64_t start;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+
+#endif
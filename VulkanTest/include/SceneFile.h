@@ -0,0 +1,46 @@
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+// One placed copy of a mesh drawn with a texture.
+struct SceneObject {
+	uint32_t mesh;    // index into SceneDescription::meshes
+	uint32_t texture; // index into SceneDescription::textures
+	glm::mat4 transform;
+};
+
+struct SceneDescription {
+	std::vector<std::string> meshes;   // OBJ paths
+	std::vector<std::string> textures; // image paths
+	std::vector<SceneObject> objects;
+};
+
+// Text scene description, one statement per line and # starting a comment. Assets are
+// declared once under a name and objects refer to them by it, so objects sharing a mesh
+// or texture share its GPU resources:
+//
+//   mesh house models/Farmhouse.obj
+//   texture house textures/Farmhouse.jpg
+//   object house house position 0 0 0 rotation 0 90 0 scale 1
+//
+// The object's mesh name comes first, then its texture name. position, rotation (degrees
+// about x, then y, then z) and a uniform scale are optional. Paths are relative to the
+// working directory, like the built in asset paths. Names declaring the same path share
+// one asset.
+class SceneFile
+{
+public:
+	// Throws on unreadable files, syntax errors and undeclared names, with the line they are on.
+	static SceneDescription load(const std::string& path);
+
+	static SceneDescription parse(const std::string& text, const std::string& path);
+
+	// A scene of one untransformed object.
+	static SceneDescription single(const std::string& meshPath, const std::string& texturePath);
+};
+
+#endif
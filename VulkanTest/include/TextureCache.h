@@ -0,0 +1,41 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+#include "TextureCompressor.h"
+
+// Block compressed mip chain, either in memory or in a mapped texture cache.
+struct CompressedTexture {
+	BlockFormat format = BlockFormat::BC1;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	std::vector<MipLevel> levels; // offsets relative to data
+	const uint8_t* data = nullptr;
+};
+
+// KTX 1.1 file holding a compressed mip chain, tagged in its key/value data with the hash
+// and size of the source image and the options it was compressed with. Other KTX tools
+// can open it, and it is read back by memory mapping without any decoding.
+class TextureCache
+{
+public:
+	// Fails if the cache is missing, malformed or was built from a different source or with other import flags.
+	bool open(const std::string& path, uint64_t sourceHash, uint64_t sourceSize, uint32_t importFlags);
+
+	void close();
+
+	const CompressedTexture& texture() const
+	{
+		return compressedTexture;
+	}
+
+	static bool write(const std::string& path, uint64_t sourceHash, uint64_t sourceSize, uint32_t importFlags, const CompressedTexture& texture);
+
+private:
+	MappedFile file;
+	CompressedTexture compressedTexture;
+};
+
+#endif
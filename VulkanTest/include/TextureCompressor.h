@@ -0,0 +1,58 @@
+#ifndef TEXTURE_COMPRESSOR_H
+#define TEXTURE_COMPRESSOR_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "MipChain.h"
+#include "ThreadPool.h"
+
+// 4x4 block compressed formats the device samples directly.
+enum class BlockFormat : uint32_t {
+	BC1, // RGB, 8 bytes per block
+	BC3, // BC1 colors plus interpolated alpha, 16 bytes per block
+	BC7  // RGBA, 16 bytes per block
+};
+
+struct TextureCompressReport {
+	BlockFormat format = BlockFormat::BC1;
+	size_t uncompressedBytes = 0;
+	size_t compressedBytes = 0;
+	double psnr = 0.0; // of level 0, in dB
+	double milliseconds = 0.0;
+
+	void print(const std::string& path) const;
+};
+
+// CPU encoder for BC1, BC3 and BC7. Endpoints are fitted along the principal axis of each
+// block's colors and refined by least squares, with the palette search vectorized over
+// four pixels at a time. BC7 blocks only use mode 6, a single subset with 4-bit indices
+// over RGBA endpoints, which is fast to search and still well ahead of BC1 in quality.
+class TextureCompressor
+{
+public:
+	static uint32_t blockBytes(BlockFormat format);
+
+	static const char* formatName(BlockFormat format);
+
+	// Offsets and sizes of each compressed level when all of them are stored back to back.
+	static std::vector<MipLevel> layout(uint32_t width, uint32_t height, uint32_t levels, BlockFormat format);
+
+	// Encodes an RGBA8 image, rows of blocks are spread over the pool.
+	static void compress(const uint8_t* rgba, uint32_t width, uint32_t height, BlockFormat format, uint8_t* blocks, ThreadPool& pool);
+
+	// Decodes an image written by compress, used to measure what the compression lost.
+	static void decompress(const uint8_t* blocks, uint32_t width, uint32_t height, BlockFormat format, uint8_t* rgba);
+
+	// Peak signal to noise ratio of compressed blocks against their source, BC1 ignoring alpha.
+	static double psnr(const uint8_t* rgba, uint32_t width, uint32_t height, BlockFormat format, const uint8_t* blocks);
+
+	static bool hasAlpha(const uint8_t* rgba, size_t pixelCount);
+
+	// One 4x4 block of RGBA8 pixels, in rows.
+	static void encodeBlock(BlockFormat format, const uint8_t* pixels, uint8_t* block);
+
+	static void decodeBlock(BlockFormat format, const uint8_t* block, uint8_t* pixels);
+};
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include <vulkan/vulkan.h>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "AppConfig.h"
+#include "MipChain.h"
+#include "TextureCache.h"
+#include "ThreadPool.h"
+
+// Complete mip chain of a texture in the format it is uploaded in.
+struct TextureMips {
+	VkFormat format = VK_FORMAT_UNDEFINED;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	std::vector<MipLevel> levels; // offsets relative to data, level 0 first
+	const uint8_t* data = nullptr;
+};
+
+// Prepares a texture's mip chain on the CPU, either on the calling thread or on the pool so
+// the renderer can keep drawing with a placeholder. Images are decoded and downsampled, then
+// block compressed unless compression is None. Compressed chains are cached as KTX next to
+// the source and mapped from there on later loads, which skips decoding entirely.
+class TextureStreamer
+{
+public:
+	TextureStreamer();
+	~TextureStreamer();
+
+	TextureStreamer(const TextureStreamer&) = delete;
+	TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+	void load(const std::string& path, TextureCompression compression);
+
+	void loadAsync(const std::string& path, TextureCompression compression, ThreadPool& pool);
+
+	// Whether the chain is ready, rethrows what an asynchronous load failed with.
+	bool isLoaded();
+
+	// Frees the chain once it has been uploaded.
+	void release();
+
+	const TextureMips& mips() const
+	{
+		return textureMips;
+	}
+
+	bool wasCached() const
+	{
+		return cached;
+	}
+
+	static VkFormat blockFormatToVk(BlockFormat format);
+
+private:
+	std::mutex mutex;
+	std::condition_variable loadFinished;
+	bool loading;
+	bool loaded;
+	std::exception_ptr error;
+
+	TextureCache cache;
+	std::vector<uint8_t> storage;
+	TextureMips textureMips;
+	bool cached;
+
+	void wait();
+};
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+
+// Fixed set of worker threads pulling tasks from one queue.
+class ThreadPool
+{
+public:
+	// 0 picks one thread per hardware thread, minus the calling thread.
+	explicit ThreadPool(uint32_t threadCount = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	uint32_t size() const
+	{
+		return (uint32_t)workers.size();
+	}
+
+	// Runs task on a worker thread, the caller is responsible for waiting on its result.
+	void enqueue(std::function<void()> task);
+
+	// Calls body(i) for every i in [0, count) across the workers and the calling thread,
+	// and returns once all of them have finished. Each index runs exactly once.
+	void parallelFor(uint32_t count, const std::function<void(uint32_t)>& body);
+
+	static ThreadPool& shared();
+
+private:
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> tasks;
+	std::mutex mutex;
+	std::condition_variable taskAvailable;
+	bool stopping;
+
+	void workerLoop();
+};
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef UPLOAD_BATCHER_H
+#define UPLOAD_BATCHER_H
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <deque>
+#include "VDeleter.h"
+#include "MemoryAllocator.h"
+
+typedef uint64_t UploadTicket;
+
+// Records transfers and layout transitions into one command buffer per batch and
+// submits it with a fence, instead of a queue round trip per operation.
+//
+// With a dedicated transfer queue, copies recorded through recordTransfer run there and
+// overlap rendering. Their results are released to the graphics family and a batch's
+// graphics half, which acquires them, is only submitted once the copies have finished, so
+// frames queued behind it never wait on a transfer. Batches without copies, such as layout
+// transitions, have nothing to acquire and are submitted right away, ahead of any still
+// waiting on theirs. Without one both halves share the graphics queue and the ownership
+// transfers become plain barriers.
+class UploadBatcher
+{
+public:
+	UploadBatcher(const VDeleter<VkDevice>& device, MemoryAllocator& allocator);
+	~UploadBatcher();
+
+	void init(VkQueue queue, uint32_t queueFamilyIndex, VkQueue transferQueue, uint32_t transferFamilyIndex);
+
+	void destroy();
+
+	bool hasTransferQueue() const
+	{
+		return transferQueue != queue;
+	}
+
+	// Graphics queue command buffer of the batch being recorded, begun on first use.
+	VkCommandBuffer record();
+
+	// Transfer queue command buffer of the batch being recorded, the graphics one without a transfer queue.
+	// Anything written through it must be handed over with transferOwnership before the graphics queue reads it.
+	VkCommandBuffer recordTransfer();
+
+	// Releases a buffer written on the transfer queue and acquires it on the graphics queue.
+	void transferOwnership(VkBuffer buffer);
+
+	// Same for an image range, which moves from oldLayout to newLayout on the way.
+	void transferOwnership(VkImage image, const VkImageSubresourceRange& range, VkImageLayout oldLayout, VkImageLayout newLayout);
+
+	// Takes ownership of a staging resource and destroys it once the current batch completes.
+	void retain(VDeleter<VkBuffer>& buffer, VAllocation& memory);
+
+	void retain(VDeleter<VkImage>& image, VAllocation& memory);
+
+	// Submits the recorded batch. Returns the ticket of the last submission if nothing was recorded.
+	UploadTicket submit();
+
+	bool isComplete(UploadTicket ticket);
+
+	void wait(UploadTicket ticket);
+
+	void flush();
+
+private:
+	struct Retained {
+		VkBuffer buffer;
+		VkImage image;
+		MemoryAllocation memory;
+	};
+
+	struct Batch {
+		UploadTicket ticket;
+		VkCommandBuffer commandBuffer;
+		VkCommandBuffer acquireCommandBuffer;
+		VkCommandBuffer transferCommandBuffer;
+		VkFence fence;
+		VkFence transferFence;
+		VkSemaphore transferSemaphore;
+		bool submitted;
+		std::vector<Retained> retained;
+		std::vector<VkBufferMemoryBarrier> bufferAcquires;
+		std::vector<VkImageMemoryBarrier> imageAcquires;
+	};
+
+	const VDeleter<VkDevice>& device;
+	MemoryAllocator& allocator;
+	VkQueue queue;
+	VkQueue transferQueue;
+	uint32_t queueFamilyIndex;
+	uint32_t transferFamilyIndex;
+	VDeleter<VkCommandPool> commandPool;
+	VDeleter<VkCommandPool> transferCommandPool;
+	Batch recording;
+	bool isRecording;
+	bool isTransferRecording;
+	std::deque<Batch> pending;
+	std::vector<VkCommandBuffer> freeCommandBuffers;
+	std::vector<VkCommandBuffer> freeTransferCommandBuffers;
+	std::vector<VkFence> freeFences;
+	std::vector<VkSemaphore> freeSemaphores;
+	UploadTicket lastSubmitted;
+	UploadTicket lastCompleted;
+
+	VkCommandBuffer begin(VkCommandPool pool, std::vector<VkCommandBuffer>& freeList);
+
+	VkFence takeFence();
+
+	void submitGraphics(Batch& batch);
+
+	void retire(Batch& batch);
+
+	void collect(bool block, UploadTicket upTo);
+};
+
+#endif
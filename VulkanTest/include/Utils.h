@@ -2,6 +2,7 @@
 #define UTILS_H
 
 #include <vector>
+#include <cstdint>
 
 struct GLFWwindow;
 
@@ -9,6 +10,7 @@ class Utils
 {
 public:
 	static std::vector<char> readFile(const std::string& filename);
+	static uint64_t hashBytes(const void* data, size_t size);
 	static double calcFPS(GLFWwindow* window, bool lastFrameDrawn, double theTimeInterval = 1.0, std::string theWindowTitle = "Vulkan");
 };
 
@@ -33,6 +33,12 @@ public:
 		return &object;
 	}
 
+	T release() {
+		T released = object;
+		object = VK_NULL_HANDLE;
+		return released;
+	}
+
 	operator T() const {
 		return object;
 	}
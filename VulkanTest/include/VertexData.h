@@ -43,6 +43,71 @@ struct Vertex {
 	}
 };
 
+// 16 byte alternative to Vertex: positions as 16-bit unorm within the mesh bounds, normals
+// octahedral encoded in two 16-bit snorms and half float texture coordinates.
+struct PackedVertex {
+	uint16_t pos[4]; // w unused
+	int16_t normal[2];
+	uint16_t texCoord[2];
+
+	static VkVertexInputBindingDescription getBindingDescription() {
+		VkVertexInputBindingDescription bindingDescription = {};
+		bindingDescription.binding = 0;
+		bindingDescription.stride = sizeof(PackedVertex);
+		bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+		return bindingDescription;
+	}
+
+	static std::array<VkVertexInputAttributeDescription, 3> getAttributeDescriptions() {
+		std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions = {};
+
+		attributeDescriptions[0].binding = 0;
+		attributeDescriptions[0].location = 0;
+		attributeDescriptions[0].format = VK_FORMAT_R16G16B16A16_UNORM;
+		attributeDescriptions[0].offset = offsetof(PackedVertex, pos);
+
+		attributeDescriptions[1].binding = 0;
+		attributeDescriptions[1].location = 1;
+		attributeDescriptions[1].format = VK_FORMAT_R16G16_SNORM;
+		attributeDescriptions[1].offset = offsetof(PackedVertex, normal);
+
+		attributeDescriptions[2].binding = 0;
+		attributeDescriptions[2].location = 2;
+		attributeDescriptions[2].format = VK_FORMAT_R16G16_SFLOAT;
+		attributeDescriptions[2].offset = offsetof(PackedVertex, texCoord);
+
+		return attributeDescriptions;
+	}
+};
+
+// Per-instance vertex data, a model matrix read as four vec4 attributes from binding 1.
+struct InstanceData {
+	glm::mat4 model;
+
+	static VkVertexInputBindingDescription getBindingDescription() {
+		VkVertexInputBindingDescription bindingDescription = {};
+		bindingDescription.binding = 1;
+		bindingDescription.stride = sizeof(InstanceData);
+		bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+		return bindingDescription;
+	}
+
+	static std::array<VkVertexInputAttributeDescription, 4> getAttributeDescriptions() {
+		std::array<VkVertexInputAttributeDescription, 4> attributeDescriptions = {};
+
+		for (uint32_t column = 0; column < 4; column++) {
+			attributeDescriptions[column].binding = 1;
+			attributeDescriptions[column].location = 3 + column;
+			attributeDescriptions[column].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+			attributeDescriptions[column].offset = (uint32_t)(offsetof(InstanceData, model) + sizeof(glm::vec4) * column);
+		}
+
+		return attributeDescriptions;
+	}
+};
+
 //const std::vector<Vertex> vertices = {
 //	{ { -0.5f, -0.5f, 0.0f },{ 1.0f, 0.0f, 0.0f },{ 0.0f, 0.0f } },
 //	{ { 0.5f, -0.5f, 0.0f },{ 0.0f, 1.0f, 0.0f },{ 1.0f, 0.0f } },
@@ -65,6 +130,9 @@ struct UniformBufferObject {
 	glm::mat4 view;
 	glm::mat4 proj;
 	glm::vec4 lightPos;
+	// Maps packed positions back to model space, pos = positionOffset + unorm * positionScale
+	glm::vec4 positionScale;
+	glm::vec4 positionOffset;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,113 @@
+#ifndef VERTEX_HASH_MAP_H
+#define VERTEX_HASH_MAP_H
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "VertexData.h"
+
+// Open addressing (linear probing) map from vertex contents to their index in a vertex array.
+// Vertices are compared bitwise, the map only stores the hash and the index of each entry.
+class VertexHashMap
+{
+public:
+	VertexHashMap(size_t expectedCount = 1024) : count(0)
+	{
+		size_t capacity = 16;
+		while (capacity < expectedCount * 2) {
+			capacity *= 2;
+		}
+		slots.assign(capacity, Slot{ 0, EMPTY });
+	}
+
+	// Returns the index of an identical vertex, appending v to vertices first if there is none.
+	uint32_t findOrInsert(const Vertex& v, std::vector<Vertex>& vertices)
+	{
+		uint32_t h = hash(v);
+		size_t mask = slots.size() - 1;
+
+		for (size_t i = h & mask;; i = (i + 1) & mask) {
+			Slot& slot = slots[i];
+
+			if (slot.index == EMPTY) {
+				uint32_t index = (uint32_t)vertices.size();
+				vertices.push_back(v);
+				slot.hash = h;
+				slot.index = index;
+
+				if (++count * 2 > slots.size()) {
+					grow();
+				}
+				return index;
+			}
+
+			if (slot.hash == h && memcmp(&vertices[slot.index], &v, sizeof(Vertex)) == 0) {
+				return slot.index;
+			}
+		}
+	}
+
+	size_t size() const
+	{
+		return count;
+	}
+
+private:
+	static const uint32_t EMPTY = 0xffffffffu;
+
+	struct Slot {
+		uint32_t hash;
+		uint32_t index;
+	};
+
+	std::vector<Slot> slots;
+	size_t count;
+
+	static uint32_t hash(const Vertex& v)
+	{
+		static_assert(sizeof(Vertex) % sizeof(uint32_t) == 0, "Vertex is hashed as 32-bit words");
+
+		uint32_t words[sizeof(Vertex) / sizeof(uint32_t)];
+		memcpy(words, &v, sizeof(Vertex));
+
+		// murmur3 style mixing, one word at a time
+		uint32_t h = 0x9747b28cu;
+		for (uint32_t k : words) {
+			k *= 0xcc9e2d51u;
+			k = (k << 15) | (k >> 17);
+			k *= 0x1b873593u;
+			h ^= k;
+			h = (h << 13) | (h >> 19);
+			h = h * 5 + 0xe6546b64u;
+		}
+
+		h ^= h >> 16;
+		h *= 0x85ebca6bu;
+		h ^= h >> 13;
+		h *= 0xc2b2ae35u;
+		h ^= h >> 16;
+		return h;
+	}
+
+	void grow()
+	{
+		std::vector<Slot> old;
+		old.swap(slots);
+		slots.assign(old.size() * 2, Slot{ 0, EMPTY });
+
+		size_t mask = slots.size() - 1;
+		for (const Slot& slot : old) {
+			if (slot.index == EMPTY) {
+				continue;
+			}
+
+			size_t i = slot.hash & mask;
+			while (slots[i].index != EMPTY) {
+				i = (i + 1) & mask;
+			}
+			slots[i] = slot;
+		}
+	}
+};
+
+#endif
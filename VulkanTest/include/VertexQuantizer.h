@@ -0,0 +1,36 @@
+#ifndef VERTEX_QUANTIZER_H
+#define VERTEX_QUANTIZER_H
+
+#include <cstdint>
+#include <string>
+#include "Mesh.h"
+
+struct QuantizationReport {
+	float maxPositionError = 0.0f;   // model space units
+	float maxNormalErrorDegrees = 0.0f;
+	float maxTexCoordError = 0.0f;
+	size_t floatBytes = 0;
+	size_t packedBytes = 0;
+	double milliseconds = 0.0;
+
+	void print(const std::string& path, const Bounds& bounds) const;
+};
+
+// Converts float vertices to PackedVertex and measures what the conversion lost.
+class VertexQuantizer
+{
+public:
+	// Positions are stored relative to bounds, out must hold mesh.vertexCount vertices.
+	static void quantize(const MeshView& mesh, PackedVertex* out, QuantizationReport& report);
+
+	// Dequantization constants for UniformBufferObject::positionScale and positionOffset.
+	static glm::vec4 positionScale(const Bounds& bounds);
+
+	static glm::vec4 positionOffset(const Bounds& bounds);
+
+	static void encodeNormal(const glm::vec3& normal, int16_t encoded[2]);
+
+	static glm::vec3 decodeNormal(const int16_t encoded[2]);
+};
+
+#endif
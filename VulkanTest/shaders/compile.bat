@@ -1,3 +1,5 @@
 C:/VulkanSDK/1.0.26.0/Bin32/glslangValidator.exe -V shader.vert
 C:/VulkanSDK/1.0.26.0/Bin32/glslangValidator.exe -V shader.frag
+C:/VulkanSDK/1.0.26.0/Bin32/glslangValidator.exe -V shader_packed.vert -o shader_packed.vert.spv
+C:/VulkanSDK/1.0.26.0/Bin32/glslangValidator.exe -V cull.comp -o cull.comp.spv
 pause
\ No newline at end of file
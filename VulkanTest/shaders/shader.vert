@@ -6,11 +6,14 @@ layout(binding = 0) uniform UniformBufferObject {
     mat4 view;
     mat4 proj;
 	vec4 lightPos;
+	vec4 positionScale;
+	vec4 positionOffset;
 } ubo;
 
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inNormal;
 layout(location = 2) in vec2 inTexCoord;
+layout(location = 3) in mat4 inInstanceModel;
 
 layout(location = 0) out vec3 outNormal;
 layout(location = 1) out vec2 fragTexCoord;
@@ -22,11 +25,12 @@ out gl_PerVertex {
 };
 
 void main() {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
+    mat4 model = ubo.model * inInstanceModel;
+    gl_Position = ubo.proj * ubo.view * model * vec4(inPosition, 1.0);
 	fragTexCoord = inTexCoord;
-	vec4 pos = ubo.model * vec4(inPosition, 1.0);
+	vec4 pos = model * vec4(inPosition, 1.0);
 	vec3 lPos = mat3(ubo.model) * ubo.lightPos.xyz;
 	outLightVec = lPos - pos.xyz;
-	outNormal = mat3(ubo.model) * inNormal;
+	outNormal = mat3(model) * inNormal;
 	outViewVec = -pos.xyz;
 }
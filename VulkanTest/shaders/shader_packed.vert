@@ -0,0 +1,46 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 model;
+    mat4 view;
+    mat4 proj;
+	vec4 lightPos;
+	vec4 positionScale;
+	vec4 positionOffset;
+} ubo;
+
+layout(location = 0) in vec4 inPackedPosition;
+layout(location = 1) in vec2 inPackedNormal;
+layout(location = 2) in vec2 inTexCoord;
+layout(location = 3) in mat4 inInstanceModel;
+
+layout(location = 0) out vec3 outNormal;
+layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) out vec3 outLightVec;
+layout(location = 3) out vec3 outViewVec;
+
+out gl_PerVertex {
+    vec4 gl_Position;
+};
+
+vec3 octahedralDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) {
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(n);
+}
+
+void main() {
+    vec3 inPosition = ubo.positionOffset.xyz + inPackedPosition.xyz * ubo.positionScale.xyz;
+    vec3 inNormal = octahedralDecode(inPackedNormal);
+    mat4 model = ubo.model * inInstanceModel;
+    gl_Position = ubo.proj * ubo.view * model * vec4(inPosition, 1.0);
+	fragTexCoord = inTexCoord;
+	vec4 pos = model * vec4(inPosition, 1.0);
+	vec3 lPos = mat3(ubo.model) * ubo.lightPos.xyz;
+	outLightVec = lPos - pos.xyz;
+	outNormal = mat3(model) * inNormal;
+	outViewVec = -pos.xyz;
+}
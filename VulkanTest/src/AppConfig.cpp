@@ -0,0 +1,165 @@
+#include "AppConfig.h"
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+static uint32_t parseUInt(const std::string& option, const char* value, uint32_t minValue, uint32_t maxValue)
+{
+	if (value == nullptr) {
+		throw std::runtime_error("missing value for " + option + "!");
+	}
+
+	unsigned long parsed;
+	try {
+		parsed = std::stoul(value);
+	}
+	catch (const std::exception&) {
+		throw std::runtime_error("invalid value for " + option + ": " + value);
+	}
+
+	if (parsed < minValue || parsed > maxValue) {
+		throw std::runtime_error(option + " must be between " + std::to_string(minValue) + " and " + std::to_string(maxValue) + "!");
+	}
+
+	return (uint32_t)parsed;
+}
+
+AppConfig AppConfig::fromCommandLine(int argc, char* argv[])
+{
+	AppConfig config;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+		if (arg == "--frames-in-flight") {
+			config.framesInFlight = parseUInt(arg, value, 1, 8);
+			i++;
+		}
+		else if (arg == "--headless") {
+			config.headless = true;
+		}
+		else if (arg == "--frames") {
+			config.headlessFrameCount = parseUInt(arg, value, 1, 1000000);
+			i++;
+		}
+		else if (arg == "--record-threads") {
+			config.recordThreads = parseUInt(arg, value, 0, 64);
+			i++;
+		}
+		else if (arg == "--gpu-profile") {
+			config.gpuProfile = true;
+		}
+		else if (arg == "--trace") {
+			config.traceFrames = parseUInt(arg, value, 1, 100000);
+			i++;
+		}
+		else if (arg == "--trace-file") {
+			if (value == nullptr) {
+				throw std::runtime_error("missing value for " + arg + "!");
+			}
+			config.tracePath = value;
+			i++;
+		}
+		else if (arg == "--no-culling") {
+			config.frustumCulling = false;
+		}
+		else if (arg == "--gpu-culling") {
+			config.gpuCulling = true;
+		}
+		else if (arg == "--scene") {
+			if (value == nullptr) {
+				throw std::runtime_error("missing value for " + arg + "!");
+			}
+			config.scenePath = value;
+			i++;
+		}
+		else if (arg == "--instances") {
+			config.instanceCount = parseUInt(arg, value, 1, 1000000);
+			i++;
+		}
+		else if (arg == "--optimize-overdraw") {
+			config.optimizeOverdraw = true;
+		}
+		else if (arg == "--packed-vertices") {
+			config.packedVertices = true;
+		}
+		else if (arg == "--texture-compression") {
+			if (value == nullptr) {
+				throw std::runtime_error("missing value for " + arg + "!");
+			}
+
+			std::string format = value;
+			if (format == "none") {
+				config.textureCompression = TextureCompression::None;
+			}
+			else if (format == "auto") {
+				config.textureCompression = TextureCompression::Auto;
+			}
+			else if (format == "bc1") {
+				config.textureCompression = TextureCompression::BC1;
+			}
+			else if (format == "bc3") {
+				config.textureCompression = TextureCompression::BC3;
+			}
+			else if (format == "bc7") {
+				config.textureCompression = TextureCompression::BC7;
+			}
+			else {
+				throw std::runtime_error("invalid value for " + arg + ": " + format);
+			}
+			i++;
+		}
+		else if (arg == "--no-transfer-queue") {
+			config.transferQueue = false;
+		}
+		else if (arg == "--no-texture-streaming") {
+			config.textureStreaming = false;
+		}
+		else if (arg == "--tinyobj") {
+			config.tinyObj = true;
+		}
+		else if (arg == "--obj-benchmark") {
+			config.objBenchmark = true;
+		}
+		else if (arg == "--obj-benchmark-size") {
+			config.objBenchmarkMegabytes = parseUInt(arg, value, 0, 65536);
+			i++;
+		}
+		else if (arg == "--help") {
+			printUsage();
+			exit(EXIT_SUCCESS);
+		}
+		else {
+			printUsage();
+			throw std::runtime_error("unknown option " + arg);
+		}
+	}
+
+	return config;
+}
+
+void AppConfig::printUsage()
+{
+	std::cout << "usage: VulkanTest [options]" << std::endl
+		<< "  --frames-in-flight N    frames recorded ahead of the GPU (1-8, default 2)" << std::endl
+		<< "  --headless              render offscreen without a window and print frame timings" << std::endl
+		<< "  --frames N              number of frames to render in headless mode (default 300)" << std::endl
+		<< "  --record-threads N      record draws into N secondary command buffers in parallel (default 0, inline)" << std::endl
+		<< "  --gpu-profile           time GPU scopes with queries and print min/avg/p99 on exit" << std::endl
+		<< "  --trace N               capture a Chrome trace of the first N frames (T captures one at runtime)" << std::endl
+		<< "  --trace-file PATH       where traces are written (default trace.json)" << std::endl
+		<< "  --no-culling            draw every submesh instead of frustum culling them" << std::endl
+		<< "  --gpu-culling           frustum cull in a compute shader and draw indirect" << std::endl
+		<< "  --scene PATH            load meshes, textures and objects from a scene file instead of the built in model" << std::endl
+		<< "  --instances N           draw N copies of the built in model on a grid (default 1)" << std::endl
+		<< "  --optimize-overdraw     also sort triangle clusters for early depth rejection when importing meshes" << std::endl
+		<< "  --packed-vertices       upload 16-bit positions, octahedral normals and half float uvs (16 instead of 32 bytes)" << std::endl
+		<< "  --texture-compression F none, auto, bc1, bc3 or bc7, cached as .ktx next to the texture (default auto)" << std::endl
+		<< "  --no-transfer-queue     upload on the graphics queue even when a transfer queue family exists" << std::endl
+		<< "  --no-texture-streaming  load textures before the first frame instead of streaming them in" << std::endl
+		<< "  --tinyobj               import OBJ files with tinyobjloader instead of the parallel parser" << std::endl
+		<< "  --obj-benchmark         time both OBJ importers on the bundled models and a generated file, then exit" << std::endl
+		<< "  --obj-benchmark-size N  size of the generated OBJ file in MiB, 0 skips it (default 1024)" << std::endl;
+}
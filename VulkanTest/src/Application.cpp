@@ -2,6 +2,12 @@
 #include <set>
 #include <algorithm>
 #include <chrono>
+#include <numeric>
+#include <iomanip>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <cstring>
 
 #include "Application.h"
 #include "Utils.h"
@@ -13,12 +19,12 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
-#define TINYOBJLOADER_IMPLEMENTATION
-#include <tiny_obj_loader.h>
-
 const int WIDTH = 800;
 const int HEIGHT = 600;
 
+// Upper bound on streamed texture data copied per frame, beyond the one level always copied
+const size_t TEXTURE_STREAM_BYTES_PER_FRAME = 4 << 20;
+
 //const std::string MODEL_PATH = "models/chalet.obj";
 //const std::string TEXTURE_PATH = "textures/chalet.jpg";
 
@@ -28,41 +34,59 @@ const std::string TEXTURE_PATH = "textures/Farmhouse.jpg";
 //const std::string MODEL_PATH = "models/cat.obj";
 //const std::string TEXTURE_PATH = "textures/cat_diff.tga";
 
-Application::Application() :
+const std::string PIPELINE_CACHE_PATH = "pipeline_cache.bin";
+
+Application::Application(const AppConfig& config) :
+	config(config),
 	validationLayers{ "VK_LAYER_LUNARG_standard_validation" },
-	deviceExtensions{ VK_KHR_SWAPCHAIN_EXTENSION_NAME },
+	deviceExtensions(config.headless ? std::vector<const char*>() : std::vector<const char*>{ VK_KHR_SWAPCHAIN_EXTENSION_NAME }),
 	instance(vkDestroyInstance),
 	debugReportCallback(instance, DestroyDebugReportCallbackEXT),
 	physicalDevice(VK_NULL_HANDLE),
+	enabledFeatures(),
+	drawIndirectCountEnabled(false),
 	device(vkDestroyDevice),
+	allocator(device),
+	uploadBatcher(device, allocator),
+	gpuProfiler(device),
 	surface(instance, vkDestroySurfaceKHR),
 	swapChain(device, vkDestroySwapchainKHR),
 	descriptorSetLayout(device, vkDestroyDescriptorSetLayout),
 	pipelineLayout(device, vkDestroyPipelineLayout),
+	pipelineCache(device, vkDestroyPipelineCache),
+	pipelineCacheWarm(false),
 	renderPass(device, vkDestroyRenderPass),
 	graphicsPipelineSolid(device, vkDestroyPipeline),
 	graphicsPipelineWireframe(device, vkDestroyPipeline),
-	commandPool(device, vkDestroyCommandPool),
-	imageAvailableSemaphore(device, vkDestroySemaphore),
-	renderFinishedSemaphore(device, vkDestroySemaphore),
-	textureImage(device, vkDestroyImage),
-	textureImageMemory(device, vkFreeMemory),
-	vertices(),
-	indices(),
-	vertexBuffer(device, vkDestroyBuffer),
-	vertexBufferMemory(device, vkFreeMemory),
-	indexBuffer(device, vkDestroyBuffer),
-	indexBufferMemory(device, vkFreeMemory),
-	uniformStagingBuffer(device, vkDestroyBuffer),
-	uniformStagingBufferMemory(device, vkFreeMemory),
+	currentFrame(0),
+	submittedFrames(0),
+	swapChainUploads(0),
+	scene(),
+	meshes(),
+	textures(),
+	batches(),
+	drawList(),
+	sceneSubmeshCount(0),
+	sceneInstanceCount(0),
+	gpuCulling(false),
+	streamStart(),
+	modelViewProjection(),
+	visibleSubmeshTotal(0),
+	culledFrameCount(0),
 	uniformBuffer(device, vkDestroyBuffer),
-	uniformBufferMemory(device, vkFreeMemory),
+	uniformBufferMemory(allocator),
+	uniformBufferMapped(nullptr),
+	uniformSliceSize(0),
 	descriptorPool(device, vkDestroyDescriptorPool),
-	textureImageView(device, vkDestroyImageView),
+	frameCounter(0),
 	textureSampler(device, vkDestroySampler),
 	depthImage(device, vkDestroyImage),
-	depthImageMemory(device, vkFreeMemory),
+	depthImageMemory(allocator),
 	depthImageView(device, vkDestroyImageView),
+	offscreenImage(device, vkDestroyImage),
+	offscreenImageMemory(allocator),
+	timestampQueryPool(device, vkDestroyQueryPool),
+	timestampPeriod(1.0f),
 	wireframe(false),
     rotateCamera(false),
     panCamera(false),
@@ -76,13 +100,27 @@ Application::Application() :
 	enableValidationLayers(true)
 #endif
 {
+	frames.resize(config.framesInFlight, FrameResources(device));
 }
 
 void Application::run()
 {
-	initWindow();
-	initVulkan();
-	mainLoop();
+	Profiler::setThreadName("main");
+
+	if (config.headless) {
+		initVulkan();
+		headlessLoop();
+	}
+	else {
+		initWindow();
+		initVulkan();
+		mainLoop();
+	}
+
+	savePipelineCache();
+
+	gpuProfiler.flush();
+	gpuProfiler.printStats(std::cout);
 }
 
 void Application::initWindow()
@@ -113,25 +151,43 @@ void Application::initVulkan() {
 	createSurface();
 	pickPhysicalDevice();
 	createLogicalDevice();
-	createSwapChain();
+	createMemoryAllocator();
+	if (config.headless) {
+		createOffscreenTarget();
+	}
+	else {
+		createSwapChain();
+	}
 	createImageViews();
 	createRenderPass();
 	createDescriptorSetLayout();
+	createPipelineCache();
 	createGraphicsPipeline();
 	createCommandPool();
+	createUploadBatcher();
+	createGpuProfiler();
 	createDepthResources();
 	createFramebuffers();
-	createTextureImage();
-	createTextureImageView();
+	loadScene();
+	createTextureImages();
 	createTextureSampler();
-	loadModel();
-	createVertexBuffer();
-	createIndexBuffer();
+	createMeshBuffers();
+	createBatches();
+	createGpuCullers();
+
+	UploadTicket uploads = uploadBatcher.submit();
+
 	createUniformBuffer();
 	createDescriptorPool();
-	createDescriptorSet();
+	createDescriptorSets();
 	createCommandBuffers();
 	createSemaphores();
+	createFences();
+	createTimestampQueries();
+
+	uploadBatcher.wait(uploads);
+
+	allocator.printStats(std::cout);
 }
 
 void Application::pickPhysicalDevice()
@@ -163,8 +219,8 @@ bool Application::isDeviceSuitable(VkPhysicalDevice device) {
 
 	bool extensionsSupported = checkDeviceExtensionSupport(device);
 
-	bool swapChainAdequate = false;
-	if (extensionsSupported) {
+	bool swapChainAdequate = config.headless;
+	if (extensionsSupported && !config.headless) {
 		SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
 		swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
 	}
@@ -205,12 +261,21 @@ QueueFamilyIndices Application::findQueueFamilies(VkPhysicalDevice device) {
 
 		if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
 			indices.graphicsFamily = i;
+
+			// Offscreen frames are never presented, the graphics queue stands in for the present queue
+			if (config.headless) {
+				indices.presentFamily = i;
+				break;
+			}
 		}
 
-		vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+		// There is no surface to query without a window
+		if (!config.headless) {
+			vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
 
-		if (queueFamily.queueCount > 0 && presentSupport) {
-			indices.presentFamily = i;
+			if (queueFamily.queueCount > 0 && presentSupport) {
+				indices.presentFamily = i;
+			}
 		}
 
 		if (indices.isComplete()) {
@@ -220,6 +285,34 @@ QueueFamilyIndices Application::findQueueFamilies(VkPhysicalDevice device) {
 		i++;
 	}
 
+	// A transfer only family is the copy engine, an async compute one can still copy without
+	// the graphics queue. Whole mip levels are always copied, which every transfer granularity allows.
+	indices.transferFamily = indices.graphicsFamily;
+	if (config.transferQueue) {
+		int computeFamily = -1;
+		for (int family = 0; family < (int)queueFamilies.size(); family++) {
+			VkQueueFlags flags = queueFamilies[family].queueFlags;
+			if (queueFamilies[family].queueCount == 0 || (flags & VK_QUEUE_GRAPHICS_BIT)) {
+				continue;
+			}
+
+			if (flags & VK_QUEUE_COMPUTE_BIT) {
+				if (computeFamily < 0) {
+					computeFamily = family;
+				}
+			}
+			else if (flags & VK_QUEUE_TRANSFER_BIT) {
+				indices.transferFamily = family;
+				computeFamily = -1;
+				break;
+			}
+		}
+
+		if (computeFamily >= 0) {
+			indices.transferFamily = computeFamily;
+		}
+	}
+
 	return indices;
 }
 
@@ -228,7 +321,7 @@ void Application::createLogicalDevice()
 	QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
 
 	std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-	std::set<int> uniqueQueueFamilies = { indices.graphicsFamily, indices.presentFamily };
+	std::set<int> uniqueQueueFamilies = { indices.graphicsFamily, indices.presentFamily, indices.transferFamily };
 
 	float queuePriority = 1.0f;
 	for (int queueFamily : uniqueQueueFamilies) {
@@ -240,8 +333,40 @@ void Application::createLogicalDevice()
 		queueCreateInfos.push_back(queueCreateInfo);
 	}
 
+	// Only ask for optional features the device has, software implementations may lack some of them
+	VkPhysicalDeviceFeatures supportedFeatures;
+	vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
 	VkPhysicalDeviceFeatures deviceFeatures = {};
-	deviceFeatures.fillModeNonSolid = true;
+	deviceFeatures.fillModeNonSolid = supportedFeatures.fillModeNonSolid;
+	deviceFeatures.samplerAnisotropy = supportedFeatures.samplerAnisotropy;
+	if (config.gpuProfile) {
+		deviceFeatures.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery;
+		deviceFeatures.inheritedQueries = supportedFeatures.inheritedQueries;
+	}
+	if (config.textureCompression != TextureCompression::None) {
+		deviceFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;
+	}
+	if (config.gpuCulling) {
+		deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+	}
+
+	// Lets indirect draws take their count from a GPU buffer, culled draws are then skipped entirely
+	std::vector<const char*> extensions(deviceExtensions);
+	if (config.gpuCulling) {
+		uint32_t extensionCount;
+		vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+
+		std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+		vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+
+		for (const auto& extension : availableExtensions) {
+			if (strcmp(extension.extensionName, VK_AMD_EXTENSION_DRAW_INDIRECT_COUNT_EXTENSION_NAME) == 0) {
+				extensions.push_back(VK_AMD_EXTENSION_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+				drawIndirectCountEnabled = true;
+			}
+		}
+	}
 
 	VkDeviceCreateInfo createInfo = {};
 	createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -251,8 +376,8 @@ void Application::createLogicalDevice()
 
 	createInfo.pEnabledFeatures = &deviceFeatures;
 
-	createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-	createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+	createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+	createInfo.ppEnabledExtensionNames = extensions.data();
 
 	if (enableValidationLayers) {
 		createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
@@ -266,8 +391,16 @@ void Application::createLogicalDevice()
 		throw std::runtime_error("failed to create logical device!");
 	}
 
+	enabledFeatures = deviceFeatures;
+
 	vkGetDeviceQueue(device, indices.graphicsFamily, 0, &graphicsQueue);
 	vkGetDeviceQueue(device, indices.presentFamily, 0, &presentQueue);
+	vkGetDeviceQueue(device, indices.transferFamily, 0, &transferQueue);
+}
+
+void Application::createMemoryAllocator()
+{
+	allocator.init(physicalDevice);
 }
 
 void Application::createInstance() {
@@ -315,6 +448,10 @@ void Application::setupDebugCallback() {
 
 void Application::createSurface()
 {
+	if (config.headless) {
+		return;
+	}
+
 	if (glfwCreateWindowSurface(instance, window, nullptr, surface.replace()) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create window surface!");
 	}
@@ -323,12 +460,14 @@ void Application::createSurface()
 std::vector<const char*> Application::getRequiredExtensions() {
 	std::vector<const char*> extensions;
 
-	unsigned int glfwExtensionCount = 0;
-	const char** glfwExtensions;
-	glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+	if (!config.headless) {
+		unsigned int glfwExtensionCount = 0;
+		const char** glfwExtensions;
+		glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
 
-	for (unsigned int i = 0; i < glfwExtensionCount; i++) {
-		extensions.push_back(glfwExtensions[i]);
+		for (unsigned int i = 0; i < glfwExtensionCount; i++) {
+			extensions.push_back(glfwExtensions[i]);
+		}
 	}
 
 	if (enableValidationLayers) {
@@ -438,6 +577,11 @@ void Application::createSwapChain() {
 		throw std::runtime_error("failed to create swap chain!");
 	}
 
+	// Presents from the old swap chain may still be queued, drawFrame destroys it once the frames after them have finished
+	if (swapChain != VK_NULL_HANDLE) {
+		retiredSwapChains.emplace_back(device, submittedFrames);
+		retiredSwapChains.back().swapChain = swapChain.release();
+	}
 	swapChain = newSwapChain;
 
 	vkGetSwapchainImagesKHR(device, swapChain, &imageCount, nullptr);
@@ -448,19 +592,66 @@ void Application::createSwapChain() {
 	swapChainExtent = extent;
 }
 
+void Application::createOffscreenTarget()
+{
+	swapChainImageFormat = VK_FORMAT_R8G8B8A8_UNORM;
+	swapChainExtent = { (uint32_t)WIDTH, (uint32_t)HEIGHT };
+
+	createImage(
+		swapChainExtent.width,
+		swapChainExtent.height,
+		1,
+		swapChainImageFormat,
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		offscreenImage,
+		offscreenImageMemory
+	);
+
+	// The offscreen image takes the place of the swap chain images for views and framebuffers
+	swapChainImages = { offscreenImage };
+}
+
 void Application::recreateSwapChain()
 {
-	vkDeviceWaitIdle(device);
+	auto start = std::chrono::steady_clock::now();
+
+	// Only the frames still in flight can use the views and framebuffers being replaced,
+	// uploads queued behind them keep running
+	std::vector<VkFence> frameFences;
+	for (FrameResources& frame : frames) {
+		frameFences.push_back(frame.inFlightFence);
+	}
+	vkWaitForFences(device, (uint32_t)frameFences.size(), frameFences.data(), VK_TRUE, std::numeric_limits<uint64_t>::max());
+
+	// The last recreate's depth transition may not have had a frame queued behind it yet
+	uploadBatcher.wait(swapChainUploads);
+
+	VkFormat oldFormat = swapChainImageFormat;
 
 	createSwapChain();
 	createImageViews();
-	createRenderPass();
-	createGraphicsPipeline();
+
+	// The render pass and pipelines only depend on the image format, the extent is dynamic state
+	bool formatChanged = swapChainImageFormat != oldFormat;
+	if (formatChanged) {
+		createRenderPass();
+		createGraphicsPipeline();
+	}
+
 	createDepthResources();
 	createFramebuffers();
-	createCommandBuffers();
+
+	imagesInFlight.assign(swapChainImages.size(), VK_NULL_HANDLE);
+
+	swapChainUploads = uploadBatcher.submit();
 
 	camera.updateAspectRatio(swapChainExtent.width / (float)swapChainExtent.height);
+
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "swap chain recreated at " << swapChainExtent.width << "x" << swapChainExtent.height << " in " << milliseconds << " ms"
+		<< (formatChanged ? ", format changed" : "") << std::endl;
 }
 
 void Application::createImageViews()
@@ -468,7 +659,7 @@ void Application::createImageViews()
 	swapChainImageViews.resize(swapChainImages.size(), VDeleter<VkImageView>{device, vkDestroyImageView});
 	for (uint32_t i = 0; i < swapChainImages.size(); i++)
 	{
-		createImageView(swapChainImages[i], swapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT, swapChainImageViews[i]);
+		createImageView(swapChainImages[i], swapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1, swapChainImageViews[i]);
 	}
 }
 
@@ -480,7 +671,7 @@ void Application::createRenderPass()
 	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
 	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	colorAttachment.finalLayout = config.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
 	VkAttachmentReference colorAttachmentRef = {};
 	colorAttachmentRef.attachment = 0;
@@ -534,7 +725,7 @@ void Application::createDescriptorSetLayout()
 {
 	VkDescriptorSetLayoutBinding uboLayoutBinding = {};
 	uboLayoutBinding.binding = 0;
-	uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	uboLayoutBinding.descriptorCount = 1;
 	uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 	uboLayoutBinding.pImmutableSamplers = nullptr; // Optional
@@ -557,9 +748,69 @@ void Application::createDescriptorSetLayout()
 	}
 }
 
+void Application::createPipelineCache()
+{
+	auto start = std::chrono::steady_clock::now();
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	VkPipelineCacheCreateInfo cacheInfo = {};
+	cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+
+	// Data from another driver or device is at best ignored, so only hand over a cache whose header matches
+	MappedFile cacheFile;
+	if (cacheFile.open(PIPELINE_CACHE_PATH) && cacheFile.size() >= 16 + VK_UUID_SIZE) {
+		uint32_t header[4];
+		memcpy(header, cacheFile.data(), sizeof(header));
+
+		if (header[0] >= 16 + VK_UUID_SIZE &&
+			header[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+			header[2] == properties.vendorID &&
+			header[3] == properties.deviceID &&
+			memcmp(cacheFile.data() + 16, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0) {
+			cacheInfo.initialDataSize = cacheFile.size();
+			cacheInfo.pInitialData = cacheFile.data();
+		}
+		else {
+			std::cout << PIPELINE_CACHE_PATH << " was created by another device or driver, discarding it" << std::endl;
+		}
+	}
+
+	if (vkCreatePipelineCache(device, &cacheInfo, nullptr, pipelineCache.replace()) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create pipeline cache!");
+	}
+
+	pipelineCacheWarm = cacheInfo.initialDataSize > 0;
+
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "pipeline cache " << (pipelineCacheWarm ? "loaded " + std::to_string(cacheInfo.initialDataSize) + " bytes" : std::string("empty"))
+		<< " in " << milliseconds << " ms" << std::endl;
+}
+
+void Application::savePipelineCache()
+{
+	size_t dataSize = 0;
+	if (vkGetPipelineCacheData(device, pipelineCache, &dataSize, nullptr) != VK_SUCCESS || dataSize == 0) {
+		return;
+	}
+
+	std::vector<char> data(dataSize);
+	if (vkGetPipelineCacheData(device, pipelineCache, &dataSize, data.data()) != VK_SUCCESS) {
+		return;
+	}
+
+	std::ofstream file(PIPELINE_CACHE_PATH, std::ios::binary | std::ios::trunc);
+	file.write(data.data(), dataSize);
+
+	if (!file.good()) {
+		std::cerr << "failed to write " << PIPELINE_CACHE_PATH << std::endl;
+	}
+}
+
 void Application::createGraphicsPipeline()
 {
-	auto vertShaderCode = Utils::readFile("shaders/shader.vert.spv");
+	auto vertShaderCode = Utils::readFile(config.packedVertices ? "shaders/shader_packed.vert.spv" : "shaders/shader.vert.spv");
 	auto fragShaderCode = Utils::readFile("shaders/shader.frag.spv");
 
 	VDeleter<VkShaderModule> vertShaderModule{ device, vkDestroyShaderModule };
@@ -582,14 +833,22 @@ void Application::createGraphicsPipeline()
 
 	VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
 
-	auto bindingDescription = Vertex::getBindingDescription();
-	auto attributeDescriptions = Vertex::getAttributeDescriptions();
+	// Binding 0 advances per vertex, binding 1 per instance
+	VkVertexInputBindingDescription bindingDescriptions[] = {
+		config.packedVertices ? PackedVertex::getBindingDescription() : Vertex::getBindingDescription(),
+		InstanceData::getBindingDescription()
+	};
+
+	auto vertexAttributes = config.packedVertices ? PackedVertex::getAttributeDescriptions() : Vertex::getAttributeDescriptions();
+	auto instanceAttributes = InstanceData::getAttributeDescriptions();
+	std::vector<VkVertexInputAttributeDescription> attributeDescriptions(vertexAttributes.begin(), vertexAttributes.end());
+	attributeDescriptions.insert(attributeDescriptions.end(), instanceAttributes.begin(), instanceAttributes.end());
 
 	VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
 	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vertexInputInfo.vertexBindingDescriptionCount = 1;
+	vertexInputInfo.vertexBindingDescriptionCount = 2;
 	vertexInputInfo.vertexAttributeDescriptionCount = (uint32_t)attributeDescriptions.size();
-	vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+	vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions;
 	vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
 
 	VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
@@ -597,24 +856,20 @@ void Application::createGraphicsPipeline()
 	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 	inputAssembly.primitiveRestartEnable = VK_FALSE;
 
-	VkViewport viewport = {};
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
-	viewport.width = (float)swapChainExtent.width;
-	viewport.height = (float)swapChainExtent.height;
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
-
-	VkRect2D scissor = {};
-	scissor.offset = { 0, 0 };
-	scissor.extent = swapChainExtent;
-
+	// Viewport and scissor are set when recording, so the pipelines survive swap chain resizes
 	VkPipelineViewportStateCreateInfo viewportState = {};
 	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
 	viewportState.viewportCount = 1;
-	viewportState.pViewports = &viewport;
+	viewportState.pViewports = nullptr;
 	viewportState.scissorCount = 1;
-	viewportState.pScissors = &scissor;
+	viewportState.pScissors = nullptr;
+
+	VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+	VkPipelineDynamicStateCreateInfo dynamicState = {};
+	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicState.dynamicStateCount = 2;
+	dynamicState.pDynamicStates = dynamicStates;
 
 	VkPipelineRasterizationStateCreateInfo rasterizer = {};
 	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
@@ -696,25 +951,35 @@ void Application::createGraphicsPipeline()
 	pipelineInfo.pMultisampleState = &multisampling;
 	pipelineInfo.pDepthStencilState = &depthStencil;
 	pipelineInfo.pColorBlendState = &colorBlending;
-	pipelineInfo.pDynamicState = nullptr; // Optional
+	pipelineInfo.pDynamicState = &dynamicState;
 	pipelineInfo.layout = pipelineLayout;
 	pipelineInfo.renderPass = renderPass;
 	pipelineInfo.subpass = 0;
 	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 	pipelineInfo.basePipelineIndex = -1; // Optional
 
+	auto start = std::chrono::steady_clock::now();
+
 	//solid pipeline
-	if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, graphicsPipelineSolid.replace()) != VK_SUCCESS) {
+	if (vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, graphicsPipelineSolid.replace()) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create solid graphics pipeline!");
 	}
 
-	rasterizer.polygonMode = VK_POLYGON_MODE_LINE;
-	rasterizer.lineWidth = 1.0f;
+	if (enabledFeatures.fillModeNonSolid) {
+		rasterizer.polygonMode = VK_POLYGON_MODE_LINE;
+		rasterizer.lineWidth = 1.0f;
 
-	//wireframe pipeline
-	if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, graphicsPipelineWireframe.replace()) != VK_SUCCESS) {
-		throw std::runtime_error("failed to create wireframe graphics pipeline!");
+		//wireframe pipeline
+		if (vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, graphicsPipelineWireframe.replace()) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create wireframe graphics pipeline!");
+		}
 	}
+
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "graphics pipelines created in " << milliseconds << " ms (" << (pipelineCacheWarm ? "warm" : "cold") << " pipeline cache)" << std::endl;
+
+	// Anything compiled from here on comes from the cache as well
+	pipelineCacheWarm = true;
 }
 
 void Application::createFramebuffers()
@@ -762,10 +1027,50 @@ void Application::createCommandPool()
 	VkCommandPoolCreateInfo poolInfo = {};
 	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 	poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily;
-	poolInfo.flags = 0; // Optional
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+	// One pool per frame in flight, so a frame's commands can be reset as a whole once its fence signals
+	for (FrameResources& frame : frames) {
+		if (vkCreateCommandPool(device, &poolInfo, nullptr, frame.commandPool.replace()) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create command pool!");
+		}
+
+		frame.secondaryCommandPools.resize(config.recordThreads, VDeleter<VkCommandPool>{device, vkDestroyCommandPool});
+		for (auto& pool : frame.secondaryCommandPools) {
+			if (vkCreateCommandPool(device, &poolInfo, nullptr, pool.replace()) != VK_SUCCESS) {
+				throw std::runtime_error("failed to create secondary command pool!");
+			}
+		}
+	}
+}
+
+void Application::createUploadBatcher()
+{
+	QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+
+	uploadBatcher.init(graphicsQueue, queueFamilyIndices.graphicsFamily, transferQueue, queueFamilyIndices.transferFamily);
+
+	if (uploadBatcher.hasTransferQueue()) {
+		std::cout << "uploading on queue family " << queueFamilyIndices.transferFamily << ", separate from graphics queue family " << queueFamilyIndices.graphicsFamily << std::endl;
+	}
+	else {
+		std::cout << "no separate transfer queue family, uploading on the graphics queue" << std::endl;
+	}
+}
+
+void Application::createGpuProfiler()
+{
+	if (!config.gpuProfile) {
+		return;
+	}
+
+	QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+
+	// Two spare slots, so uploads submitted alongside a frame have finished by the time their slot is read
+	gpuProfiler.init(physicalDevice, queueFamilyIndices.graphicsFamily, (uint32_t)frames.size() + 2, enabledFeatures.pipelineStatisticsQuery == VK_TRUE);
 
-	if (vkCreateCommandPool(device, &poolInfo, nullptr, commandPool.replace()) != VK_SUCCESS) {
-		throw std::runtime_error("failed to create command pool!");
+	if (!gpuProfiler.isEnabled()) {
+		std::cout << "neither timestamps nor pipeline statistics are supported, GPU profiling is disabled" << std::endl;
 	}
 }
 
@@ -773,11 +1078,11 @@ void Application::createDepthResources()
 {
 	VkFormat depthFormat = findDepthFormat();
 
-	createImage(swapChainExtent.width, swapChainExtent.height, depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImage, depthImageMemory);
+	createImage(swapChainExtent.width, swapChainExtent.height, 1, depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImage, depthImageMemory);
 
-	createImageView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, depthImageView);
+	createImageView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1, depthImageView);
 
-	transitionImageLayout(depthImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+	transitionImageLayout(depthImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, 1);
 }
 
 VkFormat Application::findDepthFormat()
@@ -808,69 +1113,344 @@ VkFormat Application::findSupportedFormat(const std::vector<VkFormat>& candidate
 }
 
 
-void Application::createTextureImage()
+void Application::createTextureImages()
 {
-	int texWidth, texHeight, texChannels;
-	stbi_uc* pixels = stbi_load(TEXTURE_PATH.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-	VkDeviceSize imageSize = texWidth * texHeight * 4;
+	for (auto& texture : textures) {
+		if (config.textureStreaming) {
+			createPlaceholderTexture(*texture);
+		}
+		else if (texture->pixels == nullptr) {
+			createCompressedTextureImage(*texture);
+		}
+		else {
+			createTextureImage(*texture);
+		}
 
-	if (!pixels) {
-		throw std::runtime_error("failed to load texture image!");
+		createImageView(texture->image, texture->format, VK_IMAGE_ASPECT_COLOR_BIT, texture->mipLevels, texture->imageView);
 	}
+}
+
+void Application::createTextureImage(SceneTexture& texture)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	VkDeviceSize imageSize = texture.width * texture.height * 4;
+
+	texture.mipLevels = MipChain::levelCount(texture.width, texture.height);
+
+	// Blitting needs linear filtering support for the format, otherwise the chain is built on the CPU
+	VkFormatProperties formatProperties;
+	vkGetPhysicalDeviceFormatProperties(physicalDevice, VK_FORMAT_R8G8B8A8_UNORM, &formatProperties);
+	const VkFormatFeatureFlags blitFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+	bool blitMipmaps = (formatProperties.optimalTilingFeatures & blitFeatures) == blitFeatures;
 
-	VDeleter<VkImage> stagingImage{ device, vkDestroyImage };
-	VDeleter<VkDeviceMemory> stagingImageMemory{ device, vkFreeMemory };
 	createImage(
-		texWidth,
-		texHeight,
+		texture.width, texture.height,
+		texture.mipLevels,
 		VK_FORMAT_R8G8B8A8_UNORM,
-		VK_IMAGE_TILING_LINEAR,
-		VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		stagingImage,
-		stagingImageMemory
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		texture.image,
+		texture.imageMemory
 	);
 
-	void* data;
-	vkMapMemory(device, stagingImageMemory, 0, imageSize, 0, &data);
-	memcpy(data, pixels, (size_t)imageSize);
-	vkUnmapMemory(device, stagingImageMemory);
+	transitionImageLayout(texture.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, texture.mipLevels);
+
+	// Only level 0 is staged when the GPU blits the rest, otherwise the whole chain goes in one copy
+	std::vector<MipLevel> levels = MipChain::layout(texture.width, texture.height, blitMipmaps ? 1 : texture.mipLevels);
+	VkDeviceSize stagingSize = levels.back().offset + levels.back().size;
+
+	VDeleter<VkBuffer> stagingBuffer{ device, vkDestroyBuffer };
+	VAllocation stagingBufferMemory{ allocator };
+	createBuffer(stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+	void* data = stagingBufferMemory.map();
+
+	if (blitMipmaps) {
+		memcpy(data, texture.pixels, (size_t)imageSize);
+	}
+	else {
+		// Downsampled in cached memory, reading back from the staging buffer may be uncached
+		std::vector<uint8_t> chain((size_t)stagingSize);
+		memcpy(chain.data(), texture.pixels, (size_t)imageSize);
+
+		MipChain::generate(chain.data(), levels);
+
+		memcpy(data, chain.data(), (size_t)stagingSize);
+	}
+
+	stbi_image_free(texture.pixels);
+	texture.pixels = nullptr;
+
+	copyBufferToImage(stagingBuffer, texture.image, levels);
+
+	if (blitMipmaps) {
+		generateMipmaps(texture.image, texture.width, texture.height, texture.mipLevels);
+	}
+	else {
+		transitionImageLayout(texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, texture.mipLevels);
+	}
+
+	uploadBatcher.retain(stagingBuffer, stagingBufferMemory);
+
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::cout << texture.path << ": " << texture.width << "x" << texture.height << ", " << texture.mipLevels << " mip levels "
+		<< (blitMipmaps ? "blitted on the GPU" : "downsampled on the CPU") << ", " << milliseconds << " ms" << std::endl;
+}
+
+void Application::createCompressedTextureImage(SceneTexture& texture)
+{
+	auto start = std::chrono::steady_clock::now();
 
-	stbi_image_free(pixels);
+	const TextureMips& mips = texture.streamer.mips();
+
+	texture.mipLevels = (uint32_t)mips.levels.size();
+	texture.format = mips.format;
 
 	createImage(
-		texWidth, texHeight,
-		VK_FORMAT_R8G8B8A8_UNORM,
+		mips.width, mips.height,
+		texture.mipLevels,
+		texture.format,
 		VK_IMAGE_TILING_OPTIMAL,
 		VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
 		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		textureImage,
-		textureImageMemory
+		texture.image,
+		texture.imageMemory
 	);
 
-	transitionImageLayout(stagingImage, VK_IMAGE_LAYOUT_PREINITIALIZED, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+	transitionImageLayout(texture.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, texture.mipLevels);
+
+	uploadTextureLevels(texture.image, mips, 0, texture.mipLevels);
+
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::cout << texture.path << ": " << mips.width << "x" << mips.height << ", " << texture.mipLevels << " block compressed mip levels "
+		<< (texture.streamer.wasCached() ? "mapped from " + texture.path + ".ktx" : "compressed on the CPU") << ", uploaded in " << milliseconds << " ms" << std::endl;
+
+	texture.streamer.release();
+}
+
+void Application::createPlaceholderTexture(SceneTexture& texture)
+{
+	static const uint8_t PLACEHOLDER_TEXEL[4] = { 128, 128, 128, 255 };
+
+	texture.mipLevels = 1;
+	texture.format = VK_FORMAT_R8G8B8A8_UNORM;
+
+	createImage(1, 1, 1, texture.format, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, texture.image, texture.imageMemory);
+
+	transitionImageLayout(texture.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1);
+
+	TextureMips mips;
+	mips.format = texture.format;
+	mips.width = 1;
+	mips.height = 1;
+	mips.levels = MipChain::layout(1, 1, 1);
+	mips.data = PLACEHOLDER_TEXEL;
+
+	uploadTextureLevels(texture.image, mips, 0, 1);
+}
+
+void Application::uploadTextureLevels(VkImage image, const TextureMips& mips, uint32_t firstLevel, uint32_t levelCount)
+{
+	// Staged back to back at aligned offsets, the source may interleave levels with other data
+	std::vector<MipLevel> stagingLevels(mips.levels.begin() + firstLevel, mips.levels.begin() + firstLevel + levelCount);
+
+	VkDeviceSize stagingSize = 0;
+	for (MipLevel& level : stagingLevels) {
+		level.offset = (size_t)stagingSize;
+		stagingSize += (level.size + 15) & ~(size_t)15;
+	}
+
+	VDeleter<VkBuffer> stagingBuffer{ device, vkDestroyBuffer };
+	VAllocation stagingBufferMemory{ allocator };
+	createBuffer(stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+	uint8_t* data = static_cast<uint8_t*>(stagingBufferMemory.map());
+	for (uint32_t i = 0; i < levelCount; i++) {
+		memcpy(data + stagingLevels[i].offset, mips.data + mips.levels[firstLevel + i].offset, stagingLevels[i].size);
+	}
+
+	copyBufferToImage(stagingBuffer, image, stagingLevels, 1, 0, firstLevel);
+
+	transitionImageLayout(image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, levelCount, 1, firstLevel);
 
-	transitionImageLayout(textureImage, VK_IMAGE_LAYOUT_PREINITIALIZED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+	uploadBatcher.retain(stagingBuffer, stagingBufferMemory);
+}
+
+void Application::updateTextureStreaming()
+{
+	PROFILE_SCOPE("updateTextureStreaming");
+
+	frameCounter++;
+
+	if (!config.textureStreaming) {
+		return;
+	}
+
+	// Shared by every texture, textures that don't fit wait for a later frame unless nothing was uploaded yet
+	size_t budget = TEXTURE_STREAM_BYTES_PER_FRAME;
+	std::vector<SceneTexture*> uploaded;
+
+	for (auto& texturePtr : textures) {
+		SceneTexture& texture = *texturePtr;
+		if (texture.streamed || !texture.streamer.isLoaded()) {
+			continue;
+		}
+
+		const TextureMips& mips = texture.streamer.mips();
+		uint32_t levelCount = (uint32_t)mips.levels.size();
+
+		if (texture.streamedImage == VK_NULL_HANDLE) {
+			createImage(mips.width, mips.height, levelCount, mips.format, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, texture.streamedImage, texture.streamedImageMemory);
+
+			transitionImageLayout(texture.streamedImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, levelCount);
+
+			texture.streamedLevel = levelCount;
+		}
+
+		// The spare set was last bound before the previous swap, which frames in flight no longer use after framesInFlight frames
+		if (texture.uploadPending && uploadBatcher.isComplete(texture.uploadTicket) && frameCounter - texture.descriptorSwapFrame >= config.framesInFlight) {
+			texture.retiredImageView = texture.streamedImageView.release();
+			createImageView(texture.streamedImage, mips.format, VK_IMAGE_ASPECT_COLOR_BIT, levelCount - texture.streamedLevel, texture.streamedImageView, texture.streamedLevel);
+
+			writeDescriptorSet(texture.spareDescriptorSet, texture.streamedImageView);
+			std::swap(texture.descriptorSet, texture.spareDescriptorSet);
+			texture.descriptorSwapFrame = frameCounter;
+			texture.uploadPending = false;
 
-	copyImage(stagingImage, textureImage, texWidth, texHeight);
+			if (texture.streamedLevel == 0) {
+				double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - streamStart).count();
+				std::cout << texture.path << ": " << mips.width << "x" << mips.height << ", " << levelCount << " mip levels streamed in "
+					<< milliseconds << " ms" << (texture.streamer.wasCached() ? " from the texture cache" : "") << std::endl;
 
-	transitionImageLayout(textureImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+				texture.streamer.release();
+				texture.streamed = true;
+				continue;
+			}
+		}
+
+		if (!texture.uploadPending && texture.streamedLevel > 0) {
+			// Coarsest levels first, as many as fit the budget but always at least one
+			uint32_t firstLevel = texture.streamedLevel - 1;
+			size_t uploadBytes = mips.levels[firstLevel].size;
+			if (!uploaded.empty() && uploadBytes > budget) {
+				continue;
+			}
+
+			while (firstLevel > 0 && uploadBytes + mips.levels[firstLevel - 1].size <= budget) {
+				firstLevel--;
+				uploadBytes += mips.levels[firstLevel].size;
+			}
+
+			uploadTextureLevels(texture.streamedImage, mips, firstLevel, texture.streamedLevel - firstLevel);
+
+			budget -= std::min(budget, uploadBytes);
+			texture.uploadPending = true;
+			texture.streamedLevel = firstLevel;
+			uploaded.push_back(&texture);
+		}
+	}
+
+	// One submission for every texture uploaded this frame
+	if (!uploaded.empty()) {
+		UploadTicket ticket = uploadBatcher.submit();
+		for (SceneTexture* texture : uploaded) {
+			texture->uploadTicket = ticket;
+		}
+	}
 }
 
-void Application::createTextureImageView()
+void Application::generateMipmaps(VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels)
 {
-	createImageView(textureImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT, textureImageView);
+	// Level 0 was copied on the transfer queue, blits need the graphics queue
+	transitionImageLayout(image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels);
+
+	VkCommandBuffer commandBuffer = uploadBatcher.record();
+
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = image;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+	barrier.subresourceRange.levelCount = 1;
+
+	uint32_t scope = gpuProfiler.beginScope(commandBuffer, "generateMipmaps");
+
+	int32_t mipWidth = width;
+	int32_t mipHeight = height;
+
+	// Each level is blitted from the previous one, which first has to become a transfer source
+	for (uint32_t i = 1; i < mipLevels; i++) {
+		barrier.subresourceRange.baseMipLevel = i - 1;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		int32_t nextWidth = mipWidth > 1 ? mipWidth / 2 : 1;
+		int32_t nextHeight = mipHeight > 1 ? mipHeight / 2 : 1;
+
+		VkImageBlit blit = {};
+		blit.srcOffsets[0] = { 0, 0, 0 };
+		blit.srcOffsets[1] = { mipWidth, mipHeight, 1 };
+		blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		blit.srcSubresource.mipLevel = i - 1;
+		blit.srcSubresource.baseArrayLayer = 0;
+		blit.srcSubresource.layerCount = 1;
+		blit.dstOffsets[0] = { 0, 0, 0 };
+		blit.dstOffsets[1] = { nextWidth, nextHeight, 1 };
+		blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		blit.dstSubresource.mipLevel = i;
+		blit.dstSubresource.baseArrayLayer = 0;
+		blit.dstSubresource.layerCount = 1;
+
+		vkCmdBlitImage(
+			commandBuffer,
+			image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			1, &blit,
+			VK_FILTER_LINEAR
+		);
+
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		mipWidth = nextWidth;
+		mipHeight = nextHeight;
+	}
+
+	// The last level was only ever written
+	barrier.subresourceRange.baseMipLevel = mipLevels - 1;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+	gpuProfiler.endScope(commandBuffer, scope);
 }
 
-void Application::createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, VDeleter<VkImageView>& imageView) {
+void Application::createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels, VDeleter<VkImageView>& imageView, uint32_t baseMipLevel) {
 	VkImageViewCreateInfo viewInfo = {};
 	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
 	viewInfo.image = image;
 	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
 	viewInfo.format = format;
 	viewInfo.subresourceRange.aspectMask = aspectFlags;
-	viewInfo.subresourceRange.baseMipLevel = 0;
-	viewInfo.subresourceRange.levelCount = 1;
+	viewInfo.subresourceRange.baseMipLevel = baseMipLevel;
+	viewInfo.subresourceRange.levelCount = mipLevels;
 	viewInfo.subresourceRange.baseArrayLayer = 0;
 	viewInfo.subresourceRange.layerCount = 1;
 
@@ -888,7 +1468,7 @@ void Application::createTextureSampler()
 	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
 	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
 	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-	samplerInfo.anisotropyEnable = VK_TRUE;
+	samplerInfo.anisotropyEnable = enabledFeatures.samplerAnisotropy;
 	samplerInfo.maxAnisotropy = 16;
 	samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
 	samplerInfo.compareEnable = VK_FALSE;
@@ -896,17 +1476,16 @@ void Application::createTextureSampler()
 	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
 	samplerInfo.mipLodBias = 0.0f;
 	samplerInfo.minLod = 0.0f;
-	samplerInfo.maxLod = 0.0f;
+	// Shared by textures with different level counts, each view limits the levels anyway
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
 
 	if (vkCreateSampler(device, &samplerInfo, nullptr, textureSampler.replace()) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create texture sampler!");
 	}
 }
 
-void Application::transitionImageLayout(VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout)
+void Application::transitionImageLayout(VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels, uint32_t layerCount, uint32_t baseMipLevel)
 {
-	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
 	VkImageMemoryBarrier barrier = {};
 	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
 	barrier.oldLayout = oldLayout;
@@ -914,10 +1493,10 @@ void Application::transitionImageLayout(VkImage image, VkImageLayout oldLayout,
 	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 	barrier.image = image;
-	barrier.subresourceRange.baseMipLevel = 0;
-	barrier.subresourceRange.levelCount = 1;
+	barrier.subresourceRange.baseMipLevel = baseMipLevel;
+	barrier.subresourceRange.levelCount = mipLevels;
 	barrier.subresourceRange.baseArrayLayer = 0;
-	barrier.subresourceRange.layerCount = 1;
+	barrier.subresourceRange.layerCount = layerCount;
 
 	if (newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
 		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
@@ -926,72 +1505,82 @@ void Application::transitionImageLayout(VkImage image, VkImageLayout oldLayout,
 		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 	}
 
-	if (oldLayout == VK_IMAGE_LAYOUT_PREINITIALIZED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL) {
-		barrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT;
-		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	// Filled images leave the transfer queue, to be read or blitted on the graphics queue
+	if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
+		uploadBatcher.transferOwnership(image, barrier.subresourceRange, oldLayout, newLayout);
+		return;
 	}
-	else if (oldLayout == VK_IMAGE_LAYOUT_PREINITIALIZED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-		barrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT;
+
+	// Transitions share one command buffer now, so the stages have to order them against the copies
+	VkCommandBuffer commandBuffer;
+	VkPipelineStageFlags srcStage;
+	VkPipelineStageFlags dstStage;
+
+	// Images are only ever filled by copies, so their previous contents never need to be kept.
+	// The transfer queue is then the first to use them and owns them without an ownership transfer.
+	if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
+		commandBuffer = uploadBatcher.recordTransfer();
+		barrier.srcAccessMask = 0;
 		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-	}
-	else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		srcStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		dstStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
 	}
 	else if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
 		barrier.srcAccessMask = 0;
+		commandBuffer = uploadBatcher.record();
 		barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		srcStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		dstStage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
 	}
 	else {
 		throw std::invalid_argument("unsupported layout transition!");
 	}
 
-
-
 	vkCmdPipelineBarrier(
 		commandBuffer,
-		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+		srcStage, dstStage,
 		0,
 		0, nullptr,
 		0, nullptr,
 		1, &barrier
 	);
-
-	endSingleTimeCommands(commandBuffer);
 }
 
-void Application::copyImage(VkImage srcImage, VkImage dstImage, uint32_t width, uint32_t height)
+void Application::copyBufferToImage(VkBuffer buffer, VkImage image, const std::vector<MipLevel>& levels, uint32_t layerCount, VkDeviceSize layerStride, uint32_t baseMipLevel)
 {
-	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
-	VkImageSubresourceLayers subResource = {};
-	subResource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	subResource.baseArrayLayer = 0;
-	subResource.mipLevel = 0;
-	subResource.layerCount = 1;
+	VkCommandBuffer commandBuffer = uploadBatcher.recordTransfer();
+
+	// Rows are tightly packed, a row length of 0 makes the pitch follow each level's width in texels or blocks
+	std::vector<VkBufferImageCopy> regions(levels.size() * layerCount);
+	for (uint32_t layer = 0; layer < layerCount; layer++) {
+		for (size_t i = 0; i < levels.size(); i++) {
+			VkBufferImageCopy& region = regions[layer * levels.size() + i];
+			region.bufferOffset = layer * layerStride + levels[i].offset;
+			region.bufferRowLength = 0;
+			region.bufferImageHeight = 0;
+			region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			region.imageSubresource.mipLevel = baseMipLevel + (uint32_t)i;
+			region.imageSubresource.baseArrayLayer = layer;
+			region.imageSubresource.layerCount = 1;
+			region.imageOffset = { 0, 0, 0 };
+			region.imageExtent = { levels[i].width, levels[i].height, 1 };
+		}
+	}
 
-	VkImageCopy region = {};
-	region.srcSubresource = subResource;
-	region.dstSubresource = subResource;
-	region.srcOffset = { 0, 0, 0 };
-	region.dstOffset = { 0, 0, 0 };
-	region.extent.width = width;
-	region.extent.height = height;
-	region.extent.depth = 1;
+	// Profiler queries are reset and read on the graphics queue, copies on another queue go unmeasured
+	uint32_t scope = uploadBatcher.hasTransferQueue() ? GpuProfiler::NO_SCOPE : gpuProfiler.beginScope(commandBuffer, "copyBufferToImage");
 
-	vkCmdCopyImage(
+	vkCmdCopyBufferToImage(
 		commandBuffer,
-		srcImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-		dstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-		1, &region
+		buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		(uint32_t)regions.size(), regions.data()
 	);
 
-	endSingleTimeCommands(commandBuffer);
+	gpuProfiler.endScope(commandBuffer, scope);
 }
 
-
-void Application::createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage,
-	VkMemoryPropertyFlags properties, VDeleter<VkImage>& image, VDeleter<VkDeviceMemory>& imageMemory)
+void Application::createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage,
+	VkMemoryPropertyFlags properties, VDeleter<VkImage>& image, VAllocation& imageMemory, uint32_t arrayLayers)
 {
 	VkImageCreateInfo imageInfo = {};
 	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -999,11 +1588,11 @@ void Application::createImage(uint32_t width, uint32_t height, VkFormat format,
 	imageInfo.extent.width = width;
 	imageInfo.extent.height = height;
 	imageInfo.extent.depth = 1;
-	imageInfo.mipLevels = 1;
-	imageInfo.arrayLayers = 1;
+	imageInfo.mipLevels = mipLevels;
+	imageInfo.arrayLayers = arrayLayers;
 	imageInfo.format = format;
 	imageInfo.tiling = tiling;
-	imageInfo.initialLayout = VK_IMAGE_LAYOUT_PREINITIALIZED;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 	imageInfo.usage = usage;
 	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
 	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
@@ -1015,162 +1604,553 @@ void Application::createImage(uint32_t width, uint32_t height, VkFormat format,
 	VkMemoryRequirements memRequirements;
 	vkGetImageMemoryRequirements(device, image, &memRequirements);
 
-	VkMemoryAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+	AllocationType allocationType = tiling == VK_IMAGE_TILING_OPTIMAL ? AllocationType::ImageOptimal : AllocationType::ImageLinear;
+	*imageMemory.replace() = allocator.allocate(memRequirements, properties, allocationType);
+
+	vkBindImageMemory(device, image, imageMemory, imageMemory.offset());
+}
+
+void Application::loadScene()
+{
+	auto start = std::chrono::steady_clock::now();
+
+	scene = config.scenePath.empty() ? SceneFile::single(MODEL_PATH, TEXTURE_PATH) : SceneFile::load(config.scenePath);
 
-	if (vkAllocateMemory(device, &allocInfo, nullptr, imageMemory.replace()) != VK_SUCCESS) {
-		throw std::runtime_error("failed to allocate image memory!");
+	for (const std::string& path : scene.meshes) {
+		meshes.emplace_back(new SceneMesh(device, allocator, path));
+	}
+	for (const std::string& path : scene.textures) {
+		textures.emplace_back(new SceneTexture(device, allocator, path));
+	}
+
+	TextureCompression compression = enabledFeatures.textureCompressionBC ? config.textureCompression : TextureCompression::None;
+
+	if (config.textureStreaming) {
+		streamStart = std::chrono::steady_clock::now();
+		for (auto& texture : textures) {
+			texture->streamer.loadAsync(texture->path, compression, ThreadPool::shared());
+		}
 	}
 
-	vkBindImageMemory(device, image, imageMemory, 0);
+	// Every mesh and, unless streamed, every texture is loaded on the pool, the GPU uploads follow on this thread
+	size_t textureLoads = config.textureStreaming ? 0 : textures.size();
+	ThreadPool::shared().parallelFor(meshes.size() + textureLoads, [&](size_t i) {
+		if (i < meshes.size()) {
+			loadMesh(*meshes[i]);
+			return;
+		}
+
+		SceneTexture& texture = *textures[i - meshes.size()];
+		if (compression != TextureCompression::None) {
+			texture.streamer.load(texture.path, compression);
+			return;
+		}
+
+		int channels;
+		texture.pixels = stbi_load(texture.path.c_str(), &texture.width, &texture.height, &channels, STBI_rgb_alpha);
+		if (!texture.pixels) {
+			throw std::runtime_error("failed to load texture image " + texture.path + "!");
+		}
+	});
+
+	for (auto& mesh : meshes) {
+		if (mesh->cached) {
+			std::cout << mesh->path << ".mesh: " << mesh->meshView.vertexCount << " vertices, " << mesh->meshView.indexCount << " indices mapped in " << mesh->cacheMilliseconds << " ms" << std::endl;
+		}
+		else {
+			mesh->loadReport.print(mesh->path);
+			mesh->optimizeReport.print(mesh->path);
+		}
+	}
+
+	if (!config.scenePath.empty()) {
+		double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		std::cout << config.scenePath << ": " << meshes.size() << " meshes, " << textures.size() << " textures, " << scene.objects.size() << " objects loaded in " << milliseconds << " ms" << std::endl;
+	}
 }
 
-void Application::loadModel()
+void Application::loadMesh(SceneMesh& sceneMesh)
 {
-	tinyobj::attrib_t attrib;
-	std::vector<tinyobj::shape_t> shapes;
-	std::vector<tinyobj::material_t> materials;
-	std::string err;
+	auto start = std::chrono::steady_clock::now();
 
-	if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &err, MODEL_PATH.c_str())) {
-		throw std::runtime_error(err);
+	MappedFile source;
+	if (!source.open(sceneMesh.path)) {
+		throw std::runtime_error("failed to open model file " + sceneMesh.path + "!");
 	}
 
-	for (const auto& shape : shapes) {
-		for (const auto& index : shape.mesh.indices) {
-			Vertex vertex = {};
+	uint64_t sourceHash = Utils::hashBytes(source.data(), source.size());
+	uint64_t sourceSize = source.size();
+	source.close();
 
-			vertex.pos = {
-				attrib.vertices[3 * index.vertex_index + 0],
-				attrib.vertices[3 * index.vertex_index + 1],
-				attrib.vertices[3 * index.vertex_index + 2]
-			};
+	std::string cachePath = sceneMesh.path + ".mesh";
+	uint32_t importFlags = config.optimizeOverdraw ? (uint32_t)MESH_IMPORT_OVERDRAW : 0;
 
-			if (index.normal_index >= 0)
-			{
-				vertex.normal = {
-					attrib.normals[3 * index.normal_index + 0],
-					attrib.normals[3 * index.normal_index + 1],
-					attrib.normals[3 * index.normal_index + 2]
-				};
-			}
+	if (sceneMesh.meshCache.open(cachePath, sourceHash, sourceSize, importFlags)) {
+		sceneMesh.meshView = sceneMesh.meshCache.view();
+		sceneMesh.cached = true;
+		sceneMesh.cacheMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		return;
+	}
 
-			vertex.texCoord = {
-				attrib.texcoords[2 * index.texcoord_index + 0],
-				1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
-			};
+	sceneMesh.mesh = MeshLoader::loadObj(sceneMesh.path, sceneMesh.loadReport, config.tinyObj ? ObjImporter::TinyObj : ObjImporter::Parallel);
 
-			vertices.push_back(vertex);
-			indices.push_back((uint32_t)indices.size());
-		}
+	// Done once at import, the cache stores the optimized order
+	MeshOptimizer::optimize(sceneMesh.mesh, config.optimizeOverdraw, sceneMesh.optimizeReport);
+
+	sceneMesh.meshView = sceneMesh.mesh.view();
+
+	if (!MeshCache::write(cachePath, sourceHash, sourceSize, importFlags, sceneMesh.meshView)) {
+		std::cerr << "failed to write mesh cache " << cachePath << std::endl;
+	}
+}
+
+void Application::createMeshBuffers()
+{
+	for (auto& mesh : meshes) {
+		createVertexBuffer(*mesh);
+		createIndexBuffer(*mesh);
 	}
 }
 
-void Application::createVertexBuffer()
+void Application::createVertexBuffer(SceneMesh& sceneMesh)
 {
-	VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
+	const MeshView& meshView = sceneMesh.meshView;
+	VkDeviceSize bufferSize = (config.packedVertices ? sizeof(PackedVertex) : sizeof(Vertex)) * meshView.vertexCount;
 
 	VDeleter<VkBuffer> stagingBuffer{ device, vkDestroyBuffer };
-	VDeleter<VkDeviceMemory> stagingBufferMemory{ device, vkFreeMemory };
+	VAllocation stagingBufferMemory{ allocator };
 	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
 
-	void* data;
-	vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, vertices.data(), (size_t)bufferSize);
-	vkUnmapMemory(device, stagingBufferMemory);
+	void* data = stagingBufferMemory.map();
+	if (config.packedVertices) {
+		// Quantized straight into the staging buffer, the float vertices stay the cached format
+		QuantizationReport report;
+		VertexQuantizer::quantize(meshView, (PackedVertex*)data, report);
+		report.print(sceneMesh.path, meshView.bounds);
+	}
+	else {
+		memcpy(data, meshView.vertices, (size_t)bufferSize);
+	}
+
+	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, sceneMesh.vertexBuffer, sceneMesh.vertexBufferMemory);
 
-	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory);
+	copyBuffer(stagingBuffer, sceneMesh.vertexBuffer, bufferSize);
 
-	copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
+	uploadBatcher.retain(stagingBuffer, stagingBufferMemory);
 }
 
-void Application::createIndexBuffer() {
-	VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
+void Application::createIndexBuffer(SceneMesh& sceneMesh) {
+	const MeshView& meshView = sceneMesh.meshView;
+	sceneMesh.indexLayout = IndexPacker::plan(meshView);
+
+	VkDeviceSize bufferSize = sceneMesh.indexLayout.indexSize() * meshView.indexCount;
+
+	std::cout << sceneMesh.path << ": " << (sceneMesh.indexLayout.indexType == VK_INDEX_TYPE_UINT16 ? "16" : "32") << "-bit indices in "
+		<< sceneMesh.indexLayout.chunks.size() << " chunks, " << bufferSize / 1024 << " KiB" << std::endl;
+
+	VDeleter<VkBuffer> stagingBuffer{ device, vkDestroyBuffer };
+	VAllocation stagingBufferMemory{ allocator };
+	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+	void* data = stagingBufferMemory.map();
+	IndexPacker::write(meshView, sceneMesh.indexLayout, data);
+
+	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, sceneMesh.indexBuffer, sceneMesh.indexBufferMemory);
+
+	copyBuffer(stagingBuffer, sceneMesh.indexBuffer, bufferSize);
+
+	uploadBatcher.retain(stagingBuffer, stagingBufferMemory);
+}
+
+void Application::createBatches()
+{
+	// Objects sharing a mesh and a texture become instances of one batch, in the order they first appear
+	std::map<std::pair<uint32_t, uint32_t>, uint32_t> batchIndices;
+	for (const SceneObject& object : scene.objects) {
+		auto key = std::make_pair(object.mesh, object.texture);
+		auto found = batchIndices.find(key);
+		if (found == batchIndices.end()) {
+			found = batchIndices.emplace(key, (uint32_t)batches.size()).first;
+			batches.emplace_back(new SceneBatch(device, allocator, object.mesh, object.texture));
+		}
+
+		InstanceData instance;
+		instance.model = object.transform;
+		batches[found->second]->instances.push_back(instance);
+	}
+
+	uint64_t triangleCount = 0;
+	for (auto& batchPtr : batches) {
+		SceneBatch& batch = *batchPtr;
+		const MeshView& meshView = meshes[batch.mesh]->meshView;
+
+		// The built in model is still copied onto a grid
+		if (config.scenePath.empty()) {
+			batch.instances = InstanceGrid::build(config.instanceCount, meshView.bounds);
+		}
+
+		// Instances move the submeshes, so the culled bounds have to cover every copy of them
+		batch.cullView = meshView;
+		if (batch.instances.size() > 1 || batch.instances[0].model != glm::mat4()) {
+			batch.instancedSubmeshes = InstanceGrid::coveringSubmeshes(meshView, batch.instances);
+			batch.cullView.submeshes = batch.instancedSubmeshes.data();
+		}
+
+		batch.frustumCuller.build(batch.cullView);
+
+		createInstanceBuffer(batch);
+
+		sceneSubmeshCount += (uint32_t)meshView.submeshCount;
+		sceneInstanceCount += (uint32_t)batch.instances.size();
+		triangleCount += batch.instances.size() * (meshView.indexCount / 3);
+	}
+
+	if (sceneInstanceCount > 1) {
+		std::cout << "drawing " << sceneInstanceCount << " instances in " << batches.size() << " batches, " << triangleCount << " triangles per frame" << std::endl;
+	}
+}
+
+void Application::createInstanceBuffer(SceneBatch& batch)
+{
+	VkDeviceSize bufferSize = sizeof(InstanceData) * batch.instances.size();
 
 	VDeleter<VkBuffer> stagingBuffer{ device, vkDestroyBuffer };
-	VDeleter<VkDeviceMemory> stagingBufferMemory{ device, vkFreeMemory };
+	VAllocation stagingBufferMemory{ allocator };
 	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
 
-	void* data;
-	vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, indices.data(), (size_t)bufferSize);
-	vkUnmapMemory(device, stagingBufferMemory);
+	void* data = stagingBufferMemory.map();
+	memcpy(data, batch.instances.data(), (size_t)bufferSize);
+
+	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, batch.instanceBuffer, batch.instanceBufferMemory);
+
+	copyBuffer(stagingBuffer, batch.instanceBuffer, bufferSize);
+
+	uploadBatcher.retain(stagingBuffer, stagingBufferMemory);
+}
+
+void Application::createGpuCullers()
+{
+	if (!config.gpuCulling) {
+		return;
+	}
+
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+
+	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+	// The culling dispatch is recorded into the frame's command buffer, so the graphics queue has to run compute too
+	QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+	if (!(queueFamilies[queueFamilyIndices.graphicsFamily].queueFlags & VK_QUEUE_COMPUTE_BIT)) {
+		std::cout << "the graphics queue does not support compute, culling on the CPU" << std::endl;
+		return;
+	}
+
+	PFN_vkCmdDrawIndexedIndirectCountAMD drawIndexedIndirectCount = nullptr;
+	if (drawIndirectCountEnabled) {
+		drawIndexedIndirectCount = (PFN_vkCmdDrawIndexedIndirectCountAMD)vkGetDeviceProcAddr(device, "vkCmdDrawIndexedIndirectCountAMD");
+	}
 
-	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferMemory);
+	// Each batch culls into its own indirect buffer, the pipeline cache makes the repeated pipelines cheap
+	for (auto& batch : batches) {
+		batch->gpuCuller.init(batch->cullView, meshes[batch->mesh]->indexLayout, (uint32_t)batch->instances.size(), uploadBatcher, pipelineCache,
+			drawIndexedIndirectCount, enabledFeatures.multiDrawIndirect == VK_TRUE);
+	}
+	gpuCulling = true;
 
-	copyBuffer(stagingBuffer, indexBuffer, bufferSize);
+	std::cout << "GPU culling " << sceneSubmeshCount << " submeshes in " << batches.size() << " batches, "
+		<< (drawIndexedIndirectCount != nullptr ? "draw count read from the GPU" : "culled draws have no instances") << std::endl;
 }
 
 void Application::createUniformBuffer()
 {
-	VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
 
-	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformStagingBuffer, uniformStagingBufferMemory);
-	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, uniformBuffer, uniformBufferMemory);
+	// One slice per mesh per frame in flight, each at a legal dynamic offset
+	VkDeviceSize alignment = properties.limits.minUniformBufferOffsetAlignment;
+	uniformSliceSize = (sizeof(UniformBufferObject) + alignment - 1) / alignment * alignment;
+	VkDeviceSize bufferSize = uniformSliceSize * frames.size() * meshes.size();
+
+	createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformBuffer, uniformBufferMemory);
+
+	uniformBufferMapped = static_cast<char*>(uniformBufferMemory.map());
 }
 
 void Application::createCommandBuffers()
 {
-	if (commandBuffers.size() > 0) {
-		vkFreeCommandBuffers(device, commandPool, (uint32_t)commandBuffers.size(), commandBuffers.data());
+	for (FrameResources& frame : frames) {
+		VkCommandBufferAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = frame.commandPool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = 1;
+
+		if (vkAllocateCommandBuffers(device, &allocInfo, &frame.commandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate command buffers!");
+		}
+
+		frame.secondaryCommandBuffers.resize(frame.secondaryCommandPools.size());
+		for (size_t i = 0; i < frame.secondaryCommandPools.size(); i++) {
+			allocInfo.commandPool = frame.secondaryCommandPools[i];
+			allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+
+			if (vkAllocateCommandBuffers(device, &allocInfo, &frame.secondaryCommandBuffers[i]) != VK_SUCCESS) {
+				throw std::runtime_error("failed to allocate secondary command buffers!");
+			}
+		}
 	}
+}
+
+void Application::recordCommandBuffer(FrameResources& frame, uint32_t imageIndex)
+{
+	PROFILE_SCOPE("recordCommandBuffer");
 
-	commandBuffers.resize(swapChainFramebuffers.size());
+	VkCommandBuffer commandBuffer = frame.commandBuffer;
 
-	VkCommandBufferAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.commandPool = commandPool;
-	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandBufferCount = (uint32_t)commandBuffers.size();
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	beginInfo.pInheritanceInfo = nullptr; // Optional
+
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
 
-	if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
-		throw std::runtime_error("failed to allocate command buffers!");
+	if (timestampQueryPool != VK_NULL_HANDLE) {
+		vkCmdResetQueryPool(commandBuffer, timestampQueryPool, currentFrame * 2, 2);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampQueryPool, currentFrame * 2);
 	}
 
-	for (size_t i = 0; i < commandBuffers.size(); i++) {
+	VkRenderPassBeginInfo renderPassInfo = {};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.renderPass = renderPass;
+	renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
+	renderPassInfo.renderArea.offset = { 0, 0 };
+	renderPassInfo.renderArea.extent = swapChainExtent;
+
+	std::array<VkClearValue, 2> clearValues = {};
+	clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
+	clearValues[1].depthStencil = { 1.0f, 0 };
+
+	renderPassInfo.clearValueCount = (uint32_t)clearValues.size();
+	renderPassInfo.pClearValues = clearValues.data();
+
+	// GPU culled draws are a handful of commands per batch, there is nothing to spread across threads
+	if (gpuCulling) {
+		Frustum frustum = config.frustumCulling ? Frustum::fromMatrix(modelViewProjection) : Frustum::unbounded();
+
+		uint32_t cullScope = gpuProfiler.beginScope(commandBuffer, "cull");
+		for (auto& batch : batches) {
+			batch->gpuCuller.recordCull(commandBuffer, frustum);
+		}
+		gpuProfiler.endScope(commandBuffer, cullScope);
+	}
+
+	// Statistics queries can only stay active across secondary command buffers that inherit them
+	bool secondary = !frame.secondaryCommandBuffers.empty() && !gpuCulling;
+	uint32_t scope = gpuProfiler.beginScope(commandBuffer, "render pass", !secondary || enabledFeatures.inheritedQueries);
+
+	if (gpuCulling) {
+		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		bindDrawState(commandBuffer);
+		for (auto& batch : batches) {
+			bindBatch(commandBuffer, *batch);
+			batch->gpuCuller.recordDraws(commandBuffer);
+		}
+	}
+	else if (!secondary) {
+		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		recordDraws(commandBuffer, drawList.data(), (uint32_t)drawList.size());
+	}
+	else {
+		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+		recordSecondaryCommandBuffers(frame, imageIndex);
+		vkCmdExecuteCommands(commandBuffer, (uint32_t)frame.secondaryCommandBuffers.size(), frame.secondaryCommandBuffers.data());
+	}
+
+	vkCmdEndRenderPass(commandBuffer);
+
+	gpuProfiler.endScope(commandBuffer, scope);
+
+	if (timestampQueryPool != VK_NULL_HANDLE) {
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampQueryPool, currentFrame * 2 + 1);
+	}
+
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("failed to record command buffer!");
+	}
+}
+
+void Application::recordSecondaryCommandBuffers(FrameResources& frame, uint32_t imageIndex)
+{
+	uint32_t bufferCount = (uint32_t)frame.secondaryCommandBuffers.size();
+
+	// Split the visible submeshes evenly, one run per secondary command buffer
+	uint32_t drawCount = (uint32_t)drawList.size();
+	uint32_t drawsPerBuffer = (drawCount + bufferCount - 1) / bufferCount;
+
+	VkCommandBufferInheritanceInfo inheritanceInfo = {};
+	inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritanceInfo.renderPass = renderPass;
+	inheritanceInfo.subpass = 0;
+	inheritanceInfo.framebuffer = swapChainFramebuffers[imageIndex];
+	if (enabledFeatures.inheritedQueries && enabledFeatures.pipelineStatisticsQuery) {
+		inheritanceInfo.pipelineStatistics = GpuProfiler::PIPELINE_STATISTICS;
+	}
+
+	ThreadPool::shared().parallelFor(bufferCount, [&](uint32_t i) {
+		PROFILE_SCOPE("record secondary command buffer");
+
+		VkCommandBuffer commandBuffer = frame.secondaryCommandBuffers[i];
+
+		vkResetCommandPool(device, frame.secondaryCommandPools[i], 0);
+
 		VkCommandBufferBeginInfo beginInfo = {};
 		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-		beginInfo.pInheritanceInfo = nullptr; // Optional
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+		vkBeginCommandBuffer(commandBuffer, &beginInfo);
 
-		vkBeginCommandBuffer(commandBuffers[i], &beginInfo);
+		uint32_t firstDraw = std::min(i * drawsPerBuffer, drawCount);
+		uint32_t lastDraw = std::min(firstDraw + drawsPerBuffer, drawCount);
+		recordDraws(commandBuffer, drawList.data() + firstDraw, lastDraw - firstDraw);
+
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("failed to record secondary command buffer!");
+		}
+	});
+}
+
+void Application::bindDrawState(VkCommandBuffer commandBuffer)
+{
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, wireframe && enabledFeatures.fillModeNonSolid ? graphicsPipelineWireframe : graphicsPipelineSolid);
+
+	VkViewport viewport = {};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = (float)swapChainExtent.width;
+	viewport.height = (float)swapChainExtent.height;
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
-		VkRenderPassBeginInfo renderPassInfo = {};
-		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderPassInfo.renderPass = renderPass;
-		renderPassInfo.framebuffer = swapChainFramebuffers[i];
-		renderPassInfo.renderArea.offset = { 0, 0 };
-		renderPassInfo.renderArea.extent = swapChainExtent;
+	VkRect2D scissor = {};
+	scissor.offset = { 0, 0 };
+	scissor.extent = swapChainExtent;
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+}
 
-		std::array<VkClearValue, 2> clearValues = {};
-		clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
-		clearValues[1].depthStencil = { 1.0f, 0 };
+void Application::bindBatch(VkCommandBuffer commandBuffer, const SceneBatch& batch)
+{
+	const SceneMesh& mesh = *meshes[batch.mesh];
 
-		renderPassInfo.clearValueCount = (uint32_t)clearValues.size();
-		renderPassInfo.pClearValues = clearValues.data();
+	VkBuffer vertexBuffers[] = { mesh.vertexBuffer, batch.instanceBuffer };
+	VkDeviceSize offsets[] = { 0, 0 };
+	vkCmdBindVertexBuffers(commandBuffer, 0, 2, vertexBuffers, offsets);
 
-		vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+	vkCmdBindIndexBuffer(commandBuffer, mesh.indexBuffer, 0, mesh.indexLayout.indexType);
 
-		vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, wireframe ? graphicsPipelineWireframe : graphicsPipelineSolid);
+	// The frame's slices are laid out mesh after mesh
+	uint32_t dynamicOffset = (uint32_t)((currentFrame * meshes.size() + batch.mesh) * uniformSliceSize);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &textures[batch.texture]->descriptorSet, 1, &dynamicOffset);
+}
 
-		VkBuffer vertexBuffers[] = { vertexBuffer };
-		VkDeviceSize offsets[] = { 0 };
-		vkCmdBindVertexBuffers(commandBuffers[i], 0, 1, vertexBuffers, offsets);
+void Application::recordDraws(VkCommandBuffer commandBuffer, const SceneDraw* draws, uint32_t drawCount)
+{
+	// Secondary command buffers inherit no state, so every buffer binds everything it draws with
+	bindDrawState(commandBuffer);
+
+	// Chunks of visible submeshes that follow each other in the index buffer with the same vertex offset go out as one draw
+	const SceneBatch* batch = nullptr;
+	bool pending = false;
+	IndexChunk draw = {};
+
+	for (uint32_t i = 0; i < drawCount; i++) {
+		const SceneBatch* drawBatch = batches[draws[i].batch].get();
+		if (drawBatch != batch) {
+			if (pending) {
+				vkCmdDrawIndexed(commandBuffer, draw.indexCount, (uint32_t)batch->instances.size(), draw.firstIndex, draw.vertexOffset, 0);
+				pending = false;
+			}
 
-		vkCmdBindIndexBuffer(commandBuffers[i], indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+			batch = drawBatch;
+			bindBatch(commandBuffer, *batch);
+		}
 
-		vkCmdBindDescriptorSets(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+		const IndexLayout& indexLayout = meshes[batch->mesh]->indexLayout;
+		uint32_t submesh = draws[i].submesh;
 
-		vkCmdDrawIndexed(commandBuffers[i], (uint32_t)indices.size(), 1, 0, 0, 0);
+		for (uint32_t c = indexLayout.submeshChunks[submesh]; c < indexLayout.submeshChunks[submesh + 1]; c++) {
+			const IndexChunk& chunk = indexLayout.chunks[c];
 
-		vkCmdEndRenderPass(commandBuffers[i]);
+			if (pending && chunk.firstIndex == draw.firstIndex + draw.indexCount && chunk.vertexOffset == draw.vertexOffset) {
+				draw.indexCount += chunk.indexCount;
+				continue;
+			}
 
-		if (vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS) {
-			throw std::runtime_error("failed to record command buffer!");
+			if (pending) {
+				vkCmdDrawIndexed(commandBuffer, draw.indexCount, (uint32_t)batch->instances.size(), draw.firstIndex, draw.vertexOffset, 0);
+			}
+			draw = chunk;
+			pending = true;
 		}
 	}
+
+	if (pending) {
+		vkCmdDrawIndexed(commandBuffer, draw.indexCount, (uint32_t)batch->instances.size(), draw.firstIndex, draw.vertexOffset, 0);
+	}
+}
+
+void Application::cullSubmeshes()
+{
+	PROFILE_SCOPE("cullSubmeshes");
+
+	if (gpuCulling) {
+		return;
+	}
+
+	Frustum frustum = Frustum::fromMatrix(modelViewProjection);
+
+	drawList.clear();
+	for (uint32_t b = 0; b < batches.size(); b++) {
+		SceneBatch& batch = *batches[b];
+
+		if (config.frustumCulling) {
+			batch.frustumCuller.cull(frustum, batch.visibleSubmeshes);
+		}
+		else {
+			batch.visibleSubmeshes.resize(batch.cullView.submeshCount);
+			for (uint32_t i = 0; i < batch.visibleSubmeshes.size(); i++) {
+				batch.visibleSubmeshes[i] = i;
+			}
+		}
+
+		for (uint32_t submesh : batch.visibleSubmeshes) {
+			drawList.push_back({ b, submesh });
+		}
+	}
+
+	visibleSubmeshTotal += drawList.size();
+	culledFrameCount++;
+}
+
+std::string Application::cullingStats() const
+{
+	std::ostringstream stats;
+	if (gpuCulling) {
+		stats << sceneSubmeshCount << " submeshes culled on the GPU";
+	}
+	else {
+		stats << drawList.size() << " visible, " << sceneSubmeshCount - drawList.size() << " culled of " << sceneSubmeshCount << " submeshes";
+	}
+	if (batches.size() > 1) {
+		stats << " in " << batches.size() << " batches";
+	}
+	if (sceneInstanceCount > 1) {
+		stats << ", " << sceneInstanceCount << " instances";
+	}
+	return stats.str();
 }
 
 void Application::createSemaphores()
@@ -1178,15 +2158,83 @@ void Application::createSemaphores()
 	VkSemaphoreCreateInfo semaphoreInfo = {};
 	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-	if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, imageAvailableSemaphore.replace()) != VK_SUCCESS ||
-		vkCreateSemaphore(device, &semaphoreInfo, nullptr, renderFinishedSemaphore.replace()) != VK_SUCCESS)
-	{
-		throw std::runtime_error("failed to create semaphores!");
+	for (FrameResources& frame : frames) {
+		if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, frame.imageAvailableSemaphore.replace()) != VK_SUCCESS ||
+			vkCreateSemaphore(device, &semaphoreInfo, nullptr, frame.renderFinishedSemaphore.replace()) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create semaphores!");
+		}
+	}
+}
+
+void Application::createFences()
+{
+	VkFenceCreateInfo fenceInfo = {};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+	for (FrameResources& frame : frames) {
+		if (vkCreateFence(device, &fenceInfo, nullptr, frame.inFlightFence.replace()) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create fences!");
+		}
 	}
+
+	imagesInFlight.assign(swapChainImages.size(), VK_NULL_HANDLE);
 }
 
-void Application::updateUniformBuffer()
+void Application::createTimestampQueries()
 {
+	if (!config.headless) {
+		return;
+	}
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+	QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+	if (queueFamilies[indices.graphicsFamily].timestampValidBits == 0) {
+		std::cout << "timestamps not supported on the graphics queue, GPU times will not be reported" << std::endl;
+		return;
+	}
+
+	timestampPeriod = properties.limits.timestampPeriod;
+
+	VkQueryPoolCreateInfo queryPoolInfo = {};
+	queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	queryPoolInfo.queryCount = (uint32_t)frames.size() * 2;
+
+	if (vkCreateQueryPool(device, &queryPoolInfo, nullptr, timestampQueryPool.replace()) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create timestamp query pool!");
+	}
+}
+
+void Application::readTimestampQueries(FrameResources& frame)
+{
+	if (frame.timedFrame < 0 || (VkQueryPool)timestampQueryPool == VK_NULL_HANDLE) {
+		return;
+	}
+
+	uint32_t frameIndex = (uint32_t)(&frame - frames.data());
+	uint64_t timestamps[2];
+
+	// The frame's fence has signalled, so this never waits
+	if (vkGetQueryPoolResults(device, timestampQueryPool, frameIndex * 2, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+		gpuFrameTimes[frame.timedFrame] = (timestamps[1] - timestamps[0]) * timestampPeriod / 1000000.0;
+	}
+
+	frame.timedFrame = -1;
+}
+
+void Application::updateUniformBuffer(uint32_t frameIndex)
+{
+	PROFILE_SCOPE("updateUniformBuffer");
+
 	static auto startTime = std::chrono::high_resolution_clock::now();
 
 	auto currentTime = std::chrono::high_resolution_clock::now();
@@ -1211,46 +2259,65 @@ void Application::updateUniformBuffer()
 
 	ubo.lightPos = glm::vec4(125.0f, 25.0f, 25.0f, 1.0f);
 
-	void* data;
-	vkMapMemory(device, uniformStagingBufferMemory, 0, sizeof(ubo), 0, &data);
-	memcpy(data, &ubo, sizeof(ubo));
-	vkUnmapMemory(device, uniformStagingBufferMemory);
+	modelViewProjection = ubo.proj * ubo.view * ubo.model;
+
+	// The meshes' slices only differ in how their positions are dequantized
+	for (size_t i = 0; i < meshes.size(); i++) {
+		ubo.positionScale = VertexQuantizer::positionScale(meshes[i]->meshView.bounds);
+		ubo.positionOffset = VertexQuantizer::positionOffset(meshes[i]->meshView.bounds);
 
-	copyBuffer(uniformStagingBuffer, uniformBuffer, sizeof(ubo));
+		memcpy(uniformBufferMapped + (frameIndex * meshes.size() + i) * uniformSliceSize, &ubo, sizeof(ubo));
+	}
 }
 
 void Application::createDescriptorPool()
 {
+	// Two sets per texture
+	uint32_t setCount = 2 * (uint32_t)textures.size();
+
 	std::array<VkDescriptorPoolSize, 2> poolSizes = {};
-	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	poolSizes[0].descriptorCount = 1;
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	poolSizes[0].descriptorCount = setCount;
 	poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	poolSizes[1].descriptorCount = 1;
+	poolSizes[1].descriptorCount = setCount;
 
 	VkDescriptorPoolCreateInfo poolInfo = {};
 	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
 	poolInfo.poolSizeCount = (uint32_t)poolSizes.size();
 	poolInfo.pPoolSizes = poolSizes.data();
-	poolInfo.maxSets = 1;
+	// A spare set lets the texture change without updating a set that frames in flight still use
+	poolInfo.maxSets = setCount;
 
 	if (vkCreateDescriptorPool(device, &poolInfo, nullptr, descriptorPool.replace()) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create descriptor pool!");
 	}
 }
 
-void Application::createDescriptorSet()
+void Application::createDescriptorSets()
 {
-	VkDescriptorSetLayout layouts[] = { descriptorSetLayout };
+	VkDescriptorSetLayout layouts[] = { descriptorSetLayout, descriptorSetLayout };
 	VkDescriptorSetAllocateInfo allocInfo = {};
 	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 	allocInfo.descriptorPool = descriptorPool;
-	allocInfo.descriptorSetCount = 1;
+	allocInfo.descriptorSetCount = 2;
 	allocInfo.pSetLayouts = layouts;
 
-	if (vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet) != VK_SUCCESS) {
-		throw std::runtime_error("failed to allocate descriptor set!");
+	for (auto& texture : textures) {
+		VkDescriptorSet sets[2];
+		if (vkAllocateDescriptorSets(device, &allocInfo, sets) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate descriptor set!");
+		}
+
+		texture->descriptorSet = sets[0];
+		texture->spareDescriptorSet = sets[1];
+
+		writeDescriptorSet(texture->descriptorSet, texture->imageView);
+		writeDescriptorSet(texture->spareDescriptorSet, texture->imageView);
 	}
+}
 
+void Application::writeDescriptorSet(VkDescriptorSet set, VkImageView imageView)
+{
 	VkDescriptorBufferInfo bufferInfo = {};
 	bufferInfo.buffer = uniformBuffer;
 	bufferInfo.offset = 0;
@@ -1258,21 +2325,21 @@ void Application::createDescriptorSet()
 
 	VkDescriptorImageInfo imageInfo = {};
 	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-	imageInfo.imageView = textureImageView;
+	imageInfo.imageView = imageView;
 	imageInfo.sampler = textureSampler;
 
 	std::array<VkWriteDescriptorSet, 2> descriptorWrites = {};
 
 	descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	descriptorWrites[0].dstSet = descriptorSet;
+	descriptorWrites[0].dstSet = set;
 	descriptorWrites[0].dstBinding = 0;
 	descriptorWrites[0].dstArrayElement = 0;
-	descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	descriptorWrites[0].descriptorCount = 1;
 	descriptorWrites[0].pBufferInfo = &bufferInfo;
 
 	descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	descriptorWrites[1].dstSet = descriptorSet;
+	descriptorWrites[1].dstSet = set;
 	descriptorWrites[1].dstBinding = 1;
 	descriptorWrites[1].dstArrayElement = 0;
 	descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
@@ -1284,8 +2351,33 @@ void Application::createDescriptorSet()
 
 bool Application::drawFrame()
 {
+	PROFILE_SCOPE("drawFrame");
+
+	// Anything recorded since the last frame goes ahead of it on the same queue
+	uploadBatcher.submit();
+
+	FrameResources& frame = frames[currentFrame];
+
+	// Bounds how far the CPU can run ahead: this frame's resources are reused from framesInFlight frames ago
+	{
+		PROFILE_SCOPE("wait for frame fence");
+		vkWaitForFences(device, 1, &frame.inFlightFence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+	}
+	gpuProfiler.beginFrame();
+
+	updateTextureStreaming();
+
+	// Every frame submitted before these were retired has finished, and with it the presents that used them
+	while (!retiredSwapChains.empty() && submittedFrames - retiredSwapChains.front().retireFrame >= config.framesInFlight) {
+		retiredSwapChains.pop_front();
+	}
+
 	uint32_t imageIndex;
-	VkResult result = vkAcquireNextImageKHR(device, swapChain, std::numeric_limits<uint64_t>::max(), imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
+	VkResult result;
+	{
+		PROFILE_SCOPE("vkAcquireNextImageKHR");
+		result = vkAcquireNextImageKHR(device, swapChain, std::numeric_limits<uint64_t>::max(), frame.imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
+	}
 
 	if (result == VK_ERROR_OUT_OF_DATE_KHR) {
 		recreateSwapChain();
@@ -1295,24 +2387,42 @@ bool Application::drawFrame()
 		throw std::runtime_error("failed to acquire swap chain image!");
 	}
 
+	// The image may still be rendered to by an older frame when there are fewer images than frames in flight
+	if (imagesInFlight[imageIndex] != VK_NULL_HANDLE) {
+		vkWaitForFences(device, 1, &imagesInFlight[imageIndex], VK_TRUE, std::numeric_limits<uint64_t>::max());
+	}
+	imagesInFlight[imageIndex] = frame.inFlightFence;
+
+	updateUniformBuffer(currentFrame);
+	cullSubmeshes();
+
+	vkResetCommandPool(device, frame.commandPool, 0);
+	recordCommandBuffer(frame, imageIndex);
+
 	VkSubmitInfo submitInfo = {};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-	VkSemaphore waitSemaphores[] = { imageAvailableSemaphore };
+	VkSemaphore waitSemaphores[] = { frame.imageAvailableSemaphore };
 	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
 	submitInfo.waitSemaphoreCount = 1;
 	submitInfo.pWaitSemaphores = waitSemaphores;
 	submitInfo.pWaitDstStageMask = waitStages;
 	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffers[imageIndex];
+	submitInfo.pCommandBuffers = &frame.commandBuffer;
 
-	VkSemaphore signalSemaphores[] = { renderFinishedSemaphore };
+	VkSemaphore signalSemaphores[] = { frame.renderFinishedSemaphore };
 	submitInfo.signalSemaphoreCount = 1;
 	submitInfo.pSignalSemaphores = signalSemaphores;
 
-	if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
-		throw std::runtime_error("failed to submit draw command buffer!");
+	vkResetFences(device, 1, &frame.inFlightFence);
+
+	{
+		PROFILE_SCOPE("vkQueueSubmit");
+		if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, frame.inFlightFence) != VK_SUCCESS) {
+			throw std::runtime_error("failed to submit draw command buffer!");
+		}
 	}
+	submittedFrames++;
 
 	VkPresentInfoKHR presentInfo = {};
 	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -1326,7 +2436,10 @@ bool Application::drawFrame()
 	presentInfo.pImageIndices = &imageIndex;
 	presentInfo.pResults = nullptr; // Optional
 
-	result = vkQueuePresentKHR(presentQueue, &presentInfo);
+	{
+		PROFILE_SCOPE("vkQueuePresentKHR");
+		result = vkQueuePresentKHR(presentQueue, &presentInfo);
+	}
 
 	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
 		recreateSwapChain();
@@ -1335,9 +2448,44 @@ bool Application::drawFrame()
 		throw std::runtime_error("failed to present swap chain image!");
 	}
 
+	currentFrame = (currentFrame + 1) % config.framesInFlight;
+
 	return true;
 }
 
+void Application::drawOffscreenFrame(uint32_t frameNumber)
+{
+	uploadBatcher.submit();
+
+	FrameResources& frame = frames[currentFrame];
+
+	vkWaitForFences(device, 1, &frame.inFlightFence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+	readTimestampQueries(frame);
+	gpuProfiler.beginFrame();
+
+	updateTextureStreaming();
+
+	updateUniformBuffer(currentFrame);
+	cullSubmeshes();
+
+	vkResetCommandPool(device, frame.commandPool, 0);
+	recordCommandBuffer(frame, 0);
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &frame.commandBuffer;
+
+	vkResetFences(device, 1, &frame.inFlightFence);
+
+	if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, frame.inFlightFence) != VK_SUCCESS) {
+		throw std::runtime_error("failed to submit draw command buffer!");
+	}
+
+	frame.timedFrame = frameNumber;
+	currentFrame = (currentFrame + 1) % config.framesInFlight;
+}
+
 VkSurfaceFormatKHR Application::chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats)
 {
 	if (availableFormats.size() == 1 && availableFormats[0].format == VK_FORMAT_UNDEFINED) {
@@ -1379,18 +2527,80 @@ VkExtent2D Application::chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabil
 
 void Application::mainLoop()
 {
+	Profiler::beginCapture(config.traceFrames, config.tracePath);
+
 	while (!glfwWindowShouldClose(window)) {
-		glfwPollEvents();
-		updateUniformBuffer();
-		auto timeStart = glfwGetTime();
-		bool frameDrawn = drawFrame();
-		Utils::calcFPS(window, frameDrawn);
-		auto timeEnd = glfwGetTime();
-		float deltaTime = (float)timeEnd - (float)timeStart;
-		camera.update(deltaTime);
+		{
+			PROFILE_SCOPE("frame");
+			{
+				PROFILE_SCOPE("glfwPollEvents");
+				glfwPollEvents();
+			}
+			auto timeStart = glfwGetTime();
+			bool frameDrawn = drawFrame();
+			Utils::calcFPS(window, frameDrawn, 1.0, "Vulkan | " + cullingStats());
+			auto timeEnd = glfwGetTime();
+			float deltaTime = (float)timeEnd - (float)timeStart;
+			{
+				PROFILE_SCOPE("camera.update");
+				camera.update(deltaTime);
+			}
+		}
+		Profiler::frameMark();
+	}
+
+	vkDeviceWaitIdle(device);
+}
+
+void Application::headlessLoop()
+{
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	std::cout << "headless: rendering " << config.headlessFrameCount << " frames at " << swapChainExtent.width << "x" << swapChainExtent.height
+		<< " on " << properties.deviceName << std::endl;
+
+	std::vector<double> cpuFrameTimes(config.headlessFrameCount);
+	gpuFrameTimes.assign(config.headlessFrameCount, 0.0);
+
+	auto runStart = std::chrono::steady_clock::now();
+
+	Profiler::beginCapture(config.traceFrames, config.tracePath);
+
+	for (uint32_t i = 0; i < config.headlessFrameCount; i++) {
+		auto frameStart = std::chrono::steady_clock::now();
+		{
+			PROFILE_SCOPE("frame");
+			drawOffscreenFrame(i);
+		}
+		Profiler::frameMark();
+		auto frameEnd = std::chrono::steady_clock::now();
+
+		cpuFrameTimes[i] = std::chrono::duration<double, std::milli>(frameEnd - frameStart).count();
 	}
 
 	vkDeviceWaitIdle(device);
+
+	double totalSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - runStart).count();
+
+	for (FrameResources& frame : frames) {
+		readTimestampQueries(frame);
+	}
+
+	std::cout << std::fixed << std::setprecision(3);
+	for (uint32_t i = 0; i < config.headlessFrameCount; i++) {
+		std::cout << "frame " << i << ": cpu " << cpuFrameTimes[i] << " ms, gpu " << gpuFrameTimes[i] << " ms" << std::endl;
+	}
+
+	double cpuAverage = std::accumulate(cpuFrameTimes.begin(), cpuFrameTimes.end(), 0.0) / cpuFrameTimes.size();
+	double gpuAverage = std::accumulate(gpuFrameTimes.begin(), gpuFrameTimes.end(), 0.0) / gpuFrameTimes.size();
+
+	std::cout << "average: cpu " << cpuAverage << " ms, gpu " << gpuAverage << " ms, "
+		<< config.headlessFrameCount / totalSeconds << " frames/s" << std::endl;
+	if (culledFrameCount > 0) {
+		std::cout << "culling: " << (double)visibleSubmeshTotal / culledFrameCount << " of " << sceneSubmeshCount << " submeshes visible on average" << std::endl;
+	}
+	std::cout.unsetf(std::ios::floatfield);
 }
 
 VkResult CreateDebugReportCallbackEXT(VkInstance instance, const VkDebugReportCallbackCreateInfoEXT* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkDebugReportCallbackEXT* pCallback) {
@@ -1421,6 +2631,9 @@ void Application::onWindowResized(GLFWwindow* window, int width, int height) {
 
 	Application* app = reinterpret_cast<Application*>(glfwGetWindowUserPointer(window));
 	app->recreateSwapChain();
+
+	// The event loop is blocked while a window is dragged on some platforms, so keep drawing from here
+	app->drawFrame();
 }
 
 void Application::onKeyPressed(GLFWwindow* window, int key, int scancode, int action, int mods)
@@ -1451,7 +2664,10 @@ void Application::handlePressedKey(int key, int scancode, int action, int mods)
 		case GLFW_KEY_W:
 
 			wireframe = !wireframe;
-			createCommandBuffers();
+			break;
+
+		case GLFW_KEY_T:
+			Profiler::beginCapture(config.traceFrames > 0 ? config.traceFrames : 120, config.tracePath);
 			break;
 
 		case GLFW_KEY_UP:
@@ -1575,7 +2791,7 @@ void Application::handleCursorMoved(double xpos, double ypos)
 	mousePosition = glm::vec2((float)xpos, (float)ypos);
 }
 
-void Application::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VDeleter<VkBuffer>& buffer, VDeleter<VkDeviceMemory>& bufferMemory) {
+void Application::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VDeleter<VkBuffer>& buffer, VAllocation& bufferMemory) {
 	VkBufferCreateInfo bufferInfo = {};
 	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
 	bufferInfo.size = size;
@@ -1589,74 +2805,22 @@ void Application::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMe
 	VkMemoryRequirements memRequirements;
 	vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
 
-	VkMemoryAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-	if (vkAllocateMemory(device, &allocInfo, nullptr, bufferMemory.replace()) != VK_SUCCESS) {
-		throw std::runtime_error("failed to allocate buffer memory!");
-	}
+	*bufferMemory.replace() = allocator.allocate(memRequirements, properties, AllocationType::Buffer);
 
-	vkBindBufferMemory(device, buffer, bufferMemory, 0);
+	vkBindBufferMemory(device, buffer, bufferMemory, bufferMemory.offset());
 }
 
 void Application::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
 {
-	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+	VkCommandBuffer commandBuffer = uploadBatcher.recordTransfer();
+
+	uint32_t scope = uploadBatcher.hasTransferQueue() ? GpuProfiler::NO_SCOPE : gpuProfiler.beginScope(commandBuffer, "copyBuffer");
 
 	VkBufferCopy copyRegion = {};
 	copyRegion.size = size;
 	vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
 
-	endSingleTimeCommands(commandBuffer);
-}
-
-VkCommandBuffer Application::beginSingleTimeCommands()
-{
-	VkCommandBufferAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandPool = commandPool;
-	allocInfo.commandBufferCount = 1;
-
-	VkCommandBuffer commandBuffer;
-	vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
-
-	VkCommandBufferBeginInfo beginInfo = {};
-	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-	vkBeginCommandBuffer(commandBuffer, &beginInfo);
-
-	return commandBuffer;
-}
-
-void Application::endSingleTimeCommands(VkCommandBuffer commandBuffer)
-{
-	vkEndCommandBuffer(commandBuffer);
-
-	VkSubmitInfo submitInfo = {};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffer;
+	gpuProfiler.endScope(commandBuffer, scope);
 
-	vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-	vkQueueWaitIdle(graphicsQueue);
-
-	vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+	uploadBatcher.transferOwnership(dstBuffer);
 }
-
-uint32_t Application::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
-{
-	VkPhysicalDeviceMemoryProperties memProperties;
-	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
-
-	for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-		if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-			return i;
-		}
-	}
-
-	throw std::runtime_error("failed to find suitable memory type!");
-}
\ No newline at end of file
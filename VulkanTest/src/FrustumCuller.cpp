@@ -0,0 +1,131 @@
+#include "FrustumCuller.h"
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define FRUSTUM_CULLER_SSE
+#endif
+
+Frustum Frustum::fromMatrix(const glm::mat4& matrix)
+{
+	// Rows of the matrix, glm stores columns
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++) {
+		rows[i] = glm::vec4(matrix[0][i], matrix[1][i], matrix[2][i], matrix[3][i]);
+	}
+
+	Frustum frustum;
+	frustum.planes[0] = rows[3] + rows[0];
+	frustum.planes[1] = rows[3] - rows[0];
+	frustum.planes[2] = rows[3] + rows[1];
+	frustum.planes[3] = rows[3] - rows[1];
+	frustum.planes[4] = rows[2];
+	frustum.planes[5] = rows[3] - rows[2];
+
+	for (glm::vec4& plane : frustum.planes) {
+		plane /= glm::length(glm::vec3(plane));
+	}
+
+	return frustum;
+}
+
+Frustum Frustum::unbounded()
+{
+	Frustum frustum;
+	for (glm::vec4& plane : frustum.planes) {
+		plane = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	}
+
+	return frustum;
+}
+
+void FrustumCuller::build(const MeshView& mesh)
+{
+	size_t count = mesh.submeshCount;
+	size_t padded = (count + 3) & ~(size_t)3;
+
+	centerX.assign(padded, 0.0f);
+	centerY.assign(padded, 0.0f);
+	centerZ.assign(padded, 0.0f);
+	radius.assign(padded, 0.0f);
+	boxes.resize(count);
+
+	for (size_t i = 0; i < count; i++) {
+		const Submesh& submesh = mesh.submeshes[i];
+		centerX[i] = submesh.sphere.x;
+		centerY[i] = submesh.sphere.y;
+		centerZ[i] = submesh.sphere.z;
+		radius[i] = submesh.sphere.w;
+		boxes[i] = submesh.bounds;
+	}
+}
+
+static bool boxInFrustum(const Frustum& frustum, const Bounds& box)
+{
+	// Only the corner furthest along each plane's normal needs testing
+	for (const glm::vec4& plane : frustum.planes) {
+		glm::vec3 corner(
+			plane.x >= 0.0f ? box.max.x : box.min.x,
+			plane.y >= 0.0f ? box.max.y : box.min.y,
+			plane.z >= 0.0f ? box.max.z : box.min.z
+		);
+
+		if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void FrustumCuller::cull(const Frustum& frustum, std::vector<uint32_t>& visible) const
+{
+	visible.clear();
+
+	uint32_t count = (uint32_t)boxes.size();
+
+#ifdef FRUSTUM_CULLER_SSE
+	__m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+	for (int p = 0; p < 6; p++) {
+		planeX[p] = _mm_set1_ps(frustum.planes[p].x);
+		planeY[p] = _mm_set1_ps(frustum.planes[p].y);
+		planeZ[p] = _mm_set1_ps(frustum.planes[p].z);
+		planeW[p] = _mm_set1_ps(frustum.planes[p].w);
+	}
+
+	for (uint32_t i = 0; i < count; i += 4) {
+		__m128 x = _mm_loadu_ps(&centerX[i]);
+		__m128 y = _mm_loadu_ps(&centerY[i]);
+		__m128 z = _mm_loadu_ps(&centerZ[i]);
+		__m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&radius[i]));
+
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int p = 0; p < 6; p++) {
+			__m128 distance = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(planeX[p], x), _mm_mul_ps(planeY[p], y)),
+				_mm_add_ps(_mm_mul_ps(planeZ[p], z), planeW[p])
+			);
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+		}
+
+		int mask = _mm_movemask_ps(inside);
+		for (uint32_t lane = 0; mask != 0 && lane < 4 && i + lane < count; lane++, mask >>= 1) {
+			if ((mask & 1) && boxInFrustum(frustum, boxes[i + lane])) {
+				visible.push_back(i + lane);
+			}
+		}
+	}
+#else
+	for (uint32_t i = 0; i < count; i++) {
+		bool inside = true;
+		for (const glm::vec4& plane : frustum.planes) {
+			if (plane.x * centerX[i] + plane.y * centerY[i] + plane.z * centerZ[i] + plane.w < -radius[i]) {
+				inside = false;
+				break;
+			}
+		}
+
+		if (inside && boxInFrustum(frustum, boxes[i])) {
+			visible.push_back(i);
+		}
+	}
+#endif
+}
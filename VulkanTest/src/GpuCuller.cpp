@@ -0,0 +1,290 @@
+#include "GpuCuller.h"
+#include "Utils.h"
+#include <array>
+#include <cstring>
+#include <stdexcept>
+
+GpuCuller::GpuCuller(const VDeleter<VkDevice>& device, MemoryAllocator& allocator) :
+	device(device),
+	allocator(allocator),
+	drawCount(0),
+	instanceCount(1),
+	drawIndexedIndirectCount(nullptr),
+	multiDrawIndirect(false),
+	submeshBuffer(device, vkDestroyBuffer),
+	submeshBufferMemory(allocator),
+	drawBuffer(device, vkDestroyBuffer),
+	drawBufferMemory(allocator),
+	countBuffer(device, vkDestroyBuffer),
+	countBufferMemory(allocator),
+	descriptorSetLayout(device, vkDestroyDescriptorSetLayout),
+	descriptorPool(device, vkDestroyDescriptorPool),
+	descriptorSet(VK_NULL_HANDLE),
+	pipelineLayout(device, vkDestroyPipelineLayout),
+	pipeline(device, vkDestroyPipeline)
+{
+}
+
+void GpuCuller::init(const MeshView& mesh, const IndexLayout& indexLayout, uint32_t instanceCount, UploadBatcher& uploadBatcher, VkPipelineCache pipelineCache,
+	PFN_vkCmdDrawIndexedIndirectCountAMD drawIndexedIndirectCount, bool multiDrawIndirect)
+{
+	this->drawCount = (uint32_t)indexLayout.chunks.size();
+	this->instanceCount = instanceCount;
+	this->drawIndexedIndirectCount = drawIndexedIndirectCount;
+	this->multiDrawIndirect = multiDrawIndirect;
+
+	if (drawCount == 0) {
+		return;
+	}
+
+	VkDeviceSize boundsSize = sizeof(SubmeshBounds) * drawCount;
+
+	VDeleter<VkBuffer> stagingBuffer{ device, vkDestroyBuffer };
+	VAllocation stagingBufferMemory{ allocator };
+	createBuffer(boundsSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+	SubmeshBounds* bounds = (SubmeshBounds*)stagingBufferMemory.map();
+	for (uint32_t i = 0; i < mesh.submeshCount; i++) {
+		const Submesh& submesh = mesh.submeshes[i];
+
+		for (uint32_t c = indexLayout.submeshChunks[i]; c < indexLayout.submeshChunks[i + 1]; c++) {
+			const IndexChunk& chunk = indexLayout.chunks[c];
+			bounds[c].sphere = submesh.sphere;
+			bounds[c].boxMin = glm::vec4(submesh.bounds.min, 0.0f);
+			bounds[c].boxMax = glm::vec4(submesh.bounds.max, 0.0f);
+			bounds[c].firstIndex = chunk.firstIndex;
+			bounds[c].indexCount = chunk.indexCount;
+			bounds[c].vertexOffset = chunk.vertexOffset;
+			bounds[c].pad = 0;
+		}
+	}
+
+	createBuffer(boundsSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, submeshBuffer, submeshBufferMemory);
+	createBuffer(sizeof(VkDrawIndexedIndirectCommand) * drawCount, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, drawBuffer, drawBufferMemory);
+	createBuffer(sizeof(uint32_t), VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, countBuffer, countBufferMemory);
+
+	VkCommandBuffer commandBuffer = uploadBatcher.record();
+
+	VkBufferCopy copyRegion = {};
+	copyRegion.size = boundsSize;
+	vkCmdCopyBuffer(commandBuffer, stagingBuffer, submeshBuffer, 1, &copyRegion);
+
+	uploadBatcher.retain(stagingBuffer, stagingBufferMemory);
+
+	createDescriptorSet();
+	createPipeline(pipelineCache);
+}
+
+void GpuCuller::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VDeleter<VkBuffer>& buffer, VAllocation& bufferMemory)
+{
+	VkBufferCreateInfo bufferInfo = {};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = size;
+	bufferInfo.usage = usage;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	if (vkCreateBuffer(device, &bufferInfo, nullptr, buffer.replace()) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create culling buffer!");
+	}
+
+	VkMemoryRequirements memRequirements;
+	vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+
+	*bufferMemory.replace() = allocator.allocate(memRequirements, properties, AllocationType::Buffer);
+
+	vkBindBufferMemory(device, buffer, bufferMemory, bufferMemory.offset());
+}
+
+void GpuCuller::createDescriptorSet()
+{
+	std::array<VkDescriptorSetLayoutBinding, 3> bindings = {};
+	for (uint32_t i = 0; i < bindings.size(); i++) {
+		bindings[i].binding = i;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = (uint32_t)bindings.size();
+	layoutInfo.pBindings = bindings.data();
+
+	if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, descriptorSetLayout.replace()) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create culling descriptor set layout!");
+	}
+
+	VkDescriptorPoolSize poolSize = {};
+	poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSize.descriptorCount = (uint32_t)bindings.size();
+
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.poolSizeCount = 1;
+	poolInfo.pPoolSizes = &poolSize;
+	poolInfo.maxSets = 1;
+
+	if (vkCreateDescriptorPool(device, &poolInfo, nullptr, descriptorPool.replace()) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create culling descriptor pool!");
+	}
+
+	VkDescriptorSetLayout layouts[] = { descriptorSetLayout };
+	VkDescriptorSetAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = descriptorPool;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = layouts;
+
+	if (vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet) != VK_SUCCESS) {
+		throw std::runtime_error("failed to allocate culling descriptor set!");
+	}
+
+	std::array<VkDescriptorBufferInfo, 3> bufferInfos = {};
+	bufferInfos[0].buffer = submeshBuffer;
+	bufferInfos[0].range = VK_WHOLE_SIZE;
+	bufferInfos[1].buffer = drawBuffer;
+	bufferInfos[1].range = VK_WHOLE_SIZE;
+	bufferInfos[2].buffer = countBuffer;
+	bufferInfos[2].range = VK_WHOLE_SIZE;
+
+	std::array<VkWriteDescriptorSet, 3> descriptorWrites = {};
+	for (uint32_t i = 0; i < descriptorWrites.size(); i++) {
+		descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrites[i].dstSet = descriptorSet;
+		descriptorWrites[i].dstBinding = i;
+		descriptorWrites[i].dstArrayElement = 0;
+		descriptorWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorWrites[i].descriptorCount = 1;
+		descriptorWrites[i].pBufferInfo = &bufferInfos[i];
+	}
+
+	vkUpdateDescriptorSets(device, (uint32_t)descriptorWrites.size(), descriptorWrites.data(), 0, nullptr);
+}
+
+void GpuCuller::createPipeline(VkPipelineCache pipelineCache)
+{
+	auto shaderCode = Utils::readFile("shaders/cull.comp.spv");
+
+	VkShaderModuleCreateInfo moduleInfo = {};
+	moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	moduleInfo.codeSize = shaderCode.size();
+	moduleInfo.pCode = (uint32_t*)shaderCode.data();
+
+	VDeleter<VkShaderModule> shaderModule{ device, vkDestroyShaderModule };
+	if (vkCreateShaderModule(device, &moduleInfo, nullptr, shaderModule.replace()) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create culling shader module!");
+	}
+
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(CullConstants);
+
+	VkDescriptorSetLayout setLayouts[] = { descriptorSetLayout };
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = setLayouts;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, pipelineLayout.replace()) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create culling pipeline layout!");
+	}
+
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = shaderModule;
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.layout = pipelineLayout;
+
+	if (vkCreateComputePipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, pipeline.replace()) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create culling pipeline!");
+	}
+}
+
+void GpuCuller::recordCull(VkCommandBuffer commandBuffer, const Frustum& frustum)
+{
+	if (!isEnabled()) {
+		return;
+	}
+
+	// The previous frame may still be reading the commands and count this frame overwrites
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0,
+		0, nullptr,
+		0, nullptr,
+		0, nullptr
+	);
+
+	bool compact = drawIndexedIndirectCount != nullptr;
+
+	if (compact) {
+		vkCmdFillBuffer(commandBuffer, countBuffer, 0, sizeof(uint32_t), 0);
+
+		VkMemoryBarrier clearBarrier = {};
+		clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+		vkCmdPipelineBarrier(
+			commandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0,
+			1, &clearBarrier,
+			0, nullptr,
+			0, nullptr
+		);
+	}
+
+	CullConstants constants;
+	memcpy(constants.planes, frustum.planes, sizeof(constants.planes));
+	constants.drawCount = drawCount;
+	constants.instanceCount = instanceCount;
+	constants.compact = compact ? 1 : 0;
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+	vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+	vkCmdDispatch(commandBuffer, (drawCount + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+
+	VkMemoryBarrier drawBarrier = {};
+	drawBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	drawBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	drawBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+		0,
+		1, &drawBarrier,
+		0, nullptr,
+		0, nullptr
+	);
+}
+
+void GpuCuller::recordDraws(VkCommandBuffer commandBuffer)
+{
+	if (!isEnabled()) {
+		return;
+	}
+
+	const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+
+	if (drawIndexedIndirectCount != nullptr) {
+		drawIndexedIndirectCount(commandBuffer, drawBuffer, 0, countBuffer, 0, drawCount, stride);
+	}
+	else if (multiDrawIndirect) {
+		vkCmdDrawIndexedIndirect(commandBuffer, drawBuffer, 0, drawCount, stride);
+	}
+	else {
+		// Without multiDrawIndirect each indirect draw reads a single command
+		for (uint32_t i = 0; i < drawCount; i++) {
+			vkCmdDrawIndexedIndirect(commandBuffer, drawBuffer, (VkDeviceSize)i * stride, 1, stride);
+		}
+	}
+}
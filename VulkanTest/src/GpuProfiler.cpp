@@ -0,0 +1,251 @@
+#include "GpuProfiler.h"
+#include <algorithm>
+#include <iomanip>
+#include <stdexcept>
+
+GpuProfiler::GpuProfiler(const VDeleter<VkDevice>& device) :
+	device(device),
+	timestampPool(device, vkDestroyQueryPool),
+	statisticsPool(device, vkDestroyQueryPool),
+	timestampPeriod(1.0),
+	timestampMask(0),
+	currentSlot(0),
+	droppedScopes(0)
+{
+}
+
+void GpuProfiler::init(VkPhysicalDevice physicalDevice, uint32_t queueFamilyIndex, uint32_t frameSlots, bool pipelineStatistics)
+{
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+	uint32_t validBits = queueFamilies[queueFamilyIndex].timestampValidBits;
+	timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+	timestampPeriod = properties.limits.timestampPeriod;
+
+	slots.assign(frameSlots, Slot());
+	currentSlot = 0;
+
+	VkQueryPoolCreateInfo queryPoolInfo = {};
+	queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+
+	if (validBits > 0) {
+		queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryPoolInfo.queryCount = frameSlots * MAX_SCOPES_PER_SLOT * 2;
+
+		if (vkCreateQueryPool(device, &queryPoolInfo, nullptr, timestampPool.replace()) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create profiler timestamp query pool!");
+		}
+	}
+
+	if (pipelineStatistics) {
+		queryPoolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+		queryPoolInfo.queryCount = frameSlots * MAX_SCOPES_PER_SLOT;
+		queryPoolInfo.pipelineStatistics = PIPELINE_STATISTICS;
+
+		if (vkCreateQueryPool(device, &queryPoolInfo, nullptr, statisticsPool.replace()) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create profiler pipeline statistics query pool!");
+		}
+	}
+}
+
+void GpuProfiler::beginFrame()
+{
+	if (!isEnabled()) {
+		return;
+	}
+
+	currentSlot = (currentSlot + 1) % slots.size();
+	collect(currentSlot);
+}
+
+uint32_t GpuProfiler::beginScope(VkCommandBuffer commandBuffer, const char* name, bool statistics)
+{
+	if (!isEnabled()) {
+		return NO_SCOPE;
+	}
+
+	Slot& slot = slots[currentSlot];
+	if (slot.scopes.size() == MAX_SCOPES_PER_SLOT) {
+		droppedScopes++;
+		return NO_SCOPE;
+	}
+
+	uint32_t scope = currentSlot * MAX_SCOPES_PER_SLOT + (uint32_t)slot.scopes.size();
+	statistics = statistics && (VkQueryPool)statisticsPool != VK_NULL_HANDLE;
+	slot.scopes.push_back({ name, statistics });
+
+	if ((VkQueryPool)timestampPool != VK_NULL_HANDLE) {
+		vkCmdResetQueryPool(commandBuffer, timestampPool, scope * 2, 2);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampPool, scope * 2);
+	}
+
+	if (statistics) {
+		vkCmdResetQueryPool(commandBuffer, statisticsPool, scope, 1);
+		vkCmdBeginQuery(commandBuffer, statisticsPool, scope, 0);
+	}
+
+	return scope;
+}
+
+void GpuProfiler::endScope(VkCommandBuffer commandBuffer, uint32_t scope)
+{
+	if (scope == NO_SCOPE) {
+		return;
+	}
+
+	const Scope& info = slots[scope / MAX_SCOPES_PER_SLOT].scopes[scope % MAX_SCOPES_PER_SLOT];
+	if (info.statistics) {
+		vkCmdEndQuery(commandBuffer, statisticsPool, scope);
+	}
+
+	if ((VkQueryPool)timestampPool != VK_NULL_HANDLE) {
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampPool, scope * 2 + 1);
+	}
+}
+
+void GpuProfiler::flush()
+{
+	if (!isEnabled()) {
+		return;
+	}
+
+	for (uint32_t i = 0; i < slots.size(); i++) {
+		collect(i);
+	}
+}
+
+void GpuProfiler::collect(uint32_t slotIndex)
+{
+	Slot& slot = slots[slotIndex];
+	uint32_t scopeCount = (uint32_t)slot.scopes.size();
+	if (scopeCount == 0) {
+		return;
+	}
+
+	uint32_t firstScope = slotIndex * MAX_SCOPES_PER_SLOT;
+
+	// Every query is followed by its availability, so results that are not ready yet are skipped rather than waited for
+	std::vector<uint64_t> timestamps(scopeCount * 4, 0);
+	if ((VkQueryPool)timestampPool != VK_NULL_HANDLE) {
+		vkGetQueryPoolResults(device, timestampPool, firstScope * 2, scopeCount * 2, timestamps.size() * sizeof(uint64_t), timestamps.data(),
+			2 * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+	}
+
+	std::vector<uint64_t> statistics(scopeCount * 4, 0);
+	if ((VkQueryPool)statisticsPool != VK_NULL_HANDLE) {
+		vkGetQueryPoolResults(device, statisticsPool, firstScope, scopeCount, statistics.size() * sizeof(uint64_t), statistics.data(),
+			4 * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+	}
+
+	for (uint32_t i = 0; i < scopeCount; i++) {
+		const Scope& scope = slot.scopes[i];
+		const uint64_t* timestamp = &timestamps[i * 4];
+		const uint64_t* statistic = &statistics[i * 4];
+
+		bool timestampsReady = (VkQueryPool)timestampPool == VK_NULL_HANDLE || (timestamp[1] != 0 && timestamp[3] != 0);
+		bool statisticsReady = !scope.statistics || statistic[3] != 0;
+
+		if (!timestampsReady || !statisticsReady) {
+			droppedScopes++;
+			continue;
+		}
+
+		Sample sample;
+		sample.milliseconds = ((timestamp[2] - timestamp[0]) & timestampMask) * timestampPeriod / 1000000.0;
+		sample.hasStatistics = scope.statistics;
+		sample.statistics[0] = statistic[0];
+		sample.statistics[1] = statistic[1];
+		sample.statistics[2] = statistic[2];
+
+		History& history = histories[scope.name];
+		if (history.samples.size() < HISTORY_SIZE) {
+			history.samples.push_back(sample);
+		}
+		else {
+			history.samples[history.next] = sample;
+			history.next = (history.next + 1) % HISTORY_SIZE;
+		}
+	}
+
+	slot.scopes.clear();
+}
+
+std::vector<GpuScopeStats> GpuProfiler::getStats() const
+{
+	std::vector<GpuScopeStats> result;
+
+	for (const auto& entry : histories) {
+		const std::vector<Sample>& samples = entry.second.samples;
+		if (samples.empty()) {
+			continue;
+		}
+
+		GpuScopeStats stats;
+		stats.name = entry.first;
+		stats.sampleCount = (uint32_t)samples.size();
+
+		std::vector<double> times;
+		times.reserve(samples.size());
+
+		double total = 0.0;
+		uint32_t statisticsCount = 0;
+		for (const Sample& sample : samples) {
+			times.push_back(sample.milliseconds);
+			total += sample.milliseconds;
+
+			if (sample.hasStatistics) {
+				stats.vertexInvocations += (double)sample.statistics[0];
+				stats.clippingPrimitives += (double)sample.statistics[1];
+				stats.fragmentInvocations += (double)sample.statistics[2];
+				statisticsCount++;
+			}
+		}
+
+		size_t p99Index = (times.size() * 99 + 99) / 100 - 1;
+		std::nth_element(times.begin(), times.begin() + p99Index, times.end());
+
+		stats.p99Milliseconds = times[p99Index];
+		stats.minMilliseconds = *std::min_element(times.begin(), times.end());
+		stats.avgMilliseconds = total / samples.size();
+
+		if (statisticsCount > 0) {
+			stats.vertexInvocations /= statisticsCount;
+			stats.clippingPrimitives /= statisticsCount;
+			stats.fragmentInvocations /= statisticsCount;
+		}
+
+		result.push_back(stats);
+	}
+
+	return result;
+}
+
+void GpuProfiler::printStats(std::ostream& out) const
+{
+	if (!isEnabled()) {
+		return;
+	}
+
+	out << std::fixed << std::setprecision(3);
+	out << "gpu scopes (last " << HISTORY_SIZE << " samples, " << droppedScopes << " dropped):" << std::endl;
+
+	for (const GpuScopeStats& stats : getStats()) {
+		out << "  " << stats.name << ": min " << stats.minMilliseconds << " ms, avg " << stats.avgMilliseconds
+			<< " ms, p99 " << stats.p99Milliseconds << " ms (" << stats.sampleCount << " samples)";
+
+		if ((VkQueryPool)statisticsPool != VK_NULL_HANDLE) {
+			out << std::setprecision(0) << ", " << stats.vertexInvocations << " vertex, " << stats.clippingPrimitives
+				<< " clipped primitives, " << stats.fragmentInvocations << " fragment invocations" << std::setprecision(3);
+		}
+
+		out << std::endl;
+	}
+
+	out.unsetf(std::ios::floatfield);
+}
@@ -0,0 +1,88 @@
+#include "IndexPacker.h"
+#include <algorithm>
+#include <cstring>
+
+static IndexLayout wholeSubmeshLayout(const MeshView& mesh, VkIndexType indexType)
+{
+	IndexLayout layout;
+	layout.indexType = indexType;
+	layout.submeshChunks.push_back(0);
+
+	for (size_t i = 0; i < mesh.submeshCount; i++) {
+		const Submesh& submesh = mesh.submeshes[i];
+		layout.chunks.push_back({ submesh.firstIndex, submesh.indexCount, 0 });
+		layout.submeshChunks.push_back((uint32_t)layout.chunks.size());
+	}
+
+	return layout;
+}
+
+IndexLayout IndexPacker::plan(const MeshView& mesh)
+{
+	if (mesh.vertexCount <= MAX_CHUNK_VERTICES) {
+		return wholeSubmeshLayout(mesh, VK_INDEX_TYPE_UINT16);
+	}
+
+	IndexLayout layout;
+	layout.indexType = VK_INDEX_TYPE_UINT16;
+	layout.submeshChunks.push_back(0);
+
+	// Grow each chunk a triangle at a time until its vertex range no longer fits in 16 bits
+	for (size_t i = 0; i < mesh.submeshCount; i++) {
+		const Submesh& submesh = mesh.submeshes[i];
+		uint32_t end = submesh.firstIndex + submesh.indexCount;
+
+		uint32_t chunkStart = submesh.firstIndex;
+		uint32_t minVertex = UINT32_MAX;
+		uint32_t maxVertex = 0;
+
+		for (uint32_t t = submesh.firstIndex; t < end; t += 3) {
+			const uint32_t* triangle = mesh.indices + t;
+			uint32_t triangleMin = std::min(triangle[0], std::min(triangle[1], triangle[2]));
+			uint32_t triangleMax = std::max(triangle[0], std::max(triangle[1], triangle[2]));
+
+			// A single triangle spanning more than 64K vertices can only be drawn with 32-bit indices
+			if (triangleMax - triangleMin >= MAX_CHUNK_VERTICES) {
+				return wholeSubmeshLayout(mesh, VK_INDEX_TYPE_UINT32);
+			}
+
+			uint32_t newMin = std::min(minVertex, triangleMin);
+			uint32_t newMax = std::max(maxVertex, triangleMax);
+
+			if (newMax - newMin >= MAX_CHUNK_VERTICES) {
+				layout.chunks.push_back({ chunkStart, t - chunkStart, (int32_t)minVertex });
+				chunkStart = t;
+				newMin = triangleMin;
+				newMax = triangleMax;
+			}
+
+			minVertex = newMin;
+			maxVertex = newMax;
+		}
+
+		if (end > chunkStart) {
+			layout.chunks.push_back({ chunkStart, end - chunkStart, (int32_t)minVertex });
+		}
+		layout.submeshChunks.push_back((uint32_t)layout.chunks.size());
+	}
+
+	return layout;
+}
+
+void IndexPacker::write(const MeshView& mesh, const IndexLayout& layout, void* out)
+{
+	if (layout.indexType == VK_INDEX_TYPE_UINT32) {
+		memcpy(out, mesh.indices, mesh.indexCount * sizeof(uint32_t));
+		return;
+	}
+
+	// Indices outside every chunk are never drawn, they are left zero
+	uint16_t* indices = (uint16_t*)out;
+	memset(indices, 0, mesh.indexCount * sizeof(uint16_t));
+
+	for (const IndexChunk& chunk : layout.chunks) {
+		for (uint32_t i = chunk.firstIndex; i < chunk.firstIndex + chunk.indexCount; i++) {
+			indices[i] = (uint16_t)(mesh.indices[i] - (uint32_t)chunk.vertexOffset);
+		}
+	}
+}
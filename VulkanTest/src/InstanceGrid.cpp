@@ -0,0 +1,66 @@
+#include "InstanceGrid.h"
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+
+std::vector<InstanceData> InstanceGrid::build(uint32_t count, const Bounds& meshBounds)
+{
+	std::vector<InstanceData> instances(count);
+
+	if (count == 1) {
+		instances[0].model = glm::mat4();
+		return instances;
+	}
+
+	glm::vec3 extent = meshBounds.max - meshBounds.min;
+	float spacing = std::max(extent.x, extent.z) * 1.25f;
+	if (spacing <= 0.0f) {
+		spacing = 1.0f;
+	}
+
+	uint32_t columns = (uint32_t)std::ceil(std::sqrt((double)count));
+	uint32_t rows = (count + columns - 1) / columns;
+	glm::vec3 origin(-0.5f * spacing * (columns - 1), 0.0f, -0.5f * spacing * (rows - 1));
+
+	for (uint32_t i = 0; i < count; i++) {
+		glm::vec3 offset = origin + glm::vec3(spacing * (i % columns), 0.0f, spacing * (i / columns));
+		instances[i].model = glm::translate(glm::mat4(), offset);
+	}
+
+	return instances;
+}
+
+std::vector<Submesh> InstanceGrid::coveringSubmeshes(const MeshView& mesh, const std::vector<InstanceData>& instances)
+{
+	std::vector<Submesh> submeshes(mesh.submeshes, mesh.submeshes + mesh.submeshCount);
+
+	for (Submesh& submesh : submeshes) {
+		Bounds covered = transformBounds(submesh.bounds, instances[0].model);
+		for (size_t i = 1; i < instances.size(); i++) {
+			Bounds bounds = transformBounds(submesh.bounds, instances[i].model);
+			covered.min = glm::min(covered.min, bounds.min);
+			covered.max = glm::max(covered.max, bounds.max);
+		}
+
+		submesh.bounds = covered;
+		submesh.sphere = glm::vec4((covered.min + covered.max) * 0.5f, glm::length(covered.max - covered.min) * 0.5f);
+	}
+
+	return submeshes;
+}
+
+Bounds InstanceGrid::transformBounds(const Bounds& bounds, const glm::mat4& transform)
+{
+	// Arvo's method: each matrix column adds whichever of its products with min and max is smaller or larger
+	Bounds result = { glm::vec3(transform[3]), glm::vec3(transform[3]) };
+
+	for (int column = 0; column < 3; column++) {
+		glm::vec3 axis(transform[column]);
+		glm::vec3 a = axis * bounds.min[column];
+		glm::vec3 b = axis * bounds.max[column];
+		result.min += glm::min(a, b);
+		result.max += glm::max(a, b);
+	}
+
+	return result;
+}
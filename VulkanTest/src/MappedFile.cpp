@@ -0,0 +1,142 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Empty files are opened without a mapping, data() then points at this.
+static const char emptyFile[1] = {};
+
+#ifdef _WIN32
+
+MappedFile::MappedFile() :
+	mapped(nullptr),
+	length(0),
+	file(INVALID_HANDLE_VALUE),
+	mapping(nullptr)
+{
+}
+
+bool MappedFile::open(const std::string& path)
+{
+	close();
+
+	file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize)) {
+		close();
+		return false;
+	}
+
+	length = (size_t)fileSize.QuadPart;
+	if (length == 0) {
+		mapped = emptyFile;
+		return true;
+	}
+
+	mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr) {
+		close();
+		return false;
+	}
+
+	mapped = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (mapped == nullptr) {
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (mapped != nullptr && mapped != emptyFile) {
+		UnmapViewOfFile(mapped);
+	}
+	if (mapping != nullptr) {
+		CloseHandle(mapping);
+	}
+	if (file != INVALID_HANDLE_VALUE) {
+		CloseHandle(file);
+	}
+
+	mapped = nullptr;
+	length = 0;
+	file = INVALID_HANDLE_VALUE;
+	mapping = nullptr;
+}
+
+#else
+
+MappedFile::MappedFile() :
+	mapped(nullptr),
+	length(0),
+	file(-1)
+{
+}
+
+bool MappedFile::open(const std::string& path)
+{
+	close();
+
+	file = ::open(path.c_str(), O_RDONLY);
+	if (file < 0) {
+		return false;
+	}
+
+	struct stat fileStat;
+	if (fstat(file, &fileStat) != 0) {
+		close();
+		return false;
+	}
+
+	length = (size_t)fileStat.st_size;
+	if (length == 0) {
+		mapped = emptyFile;
+		return true;
+	}
+
+	void* view = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, file, 0);
+	if (view == MAP_FAILED) {
+		close();
+		return false;
+	}
+
+	madvise(view, length, MADV_SEQUENTIAL);
+	mapped = static_cast<const char*>(view);
+
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (mapped != nullptr && mapped != emptyFile) {
+		munmap(const_cast<char*>(mapped), length);
+	}
+	if (file >= 0) {
+		::close(file);
+	}
+
+	mapped = nullptr;
+	length = 0;
+	file = -1;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+	close();
+}
@@ -0,0 +1,375 @@
+#include "MemoryAllocator.h"
+#include <algorithm>
+#include <iomanip>
+#include <stdexcept>
+
+struct Suballocation {
+	VkDeviceSize offset;
+	VkDeviceSize size;
+	AllocationType type;
+};
+
+struct MemoryBlock {
+	VkDeviceMemory memory;
+	VkDeviceSize size;
+	uint32_t memoryTypeIndex;
+	bool dedicated;
+	void* mapped;
+	// Sorted by offset and covering the whole block, adjacent free ranges are always merged.
+	std::vector<Suballocation> suballocations;
+};
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+static bool onSamePage(VkDeviceSize offsetA, VkDeviceSize sizeA, VkDeviceSize offsetB, VkDeviceSize pageSize)
+{
+	VkDeviceSize endPageA = (offsetA + sizeA - 1) & ~(pageSize - 1);
+	VkDeviceSize startPageB = offsetB & ~(pageSize - 1);
+	return endPageA == startPageB;
+}
+
+static bool typesConflict(AllocationType a, AllocationType b)
+{
+	if (a == AllocationType::Free || b == AllocationType::Free) {
+		return false;
+	}
+	return (a == AllocationType::ImageOptimal) != (b == AllocationType::ImageOptimal);
+}
+
+static bool isEmpty(const MemoryBlock* block)
+{
+	return block->suballocations.size() == 1 && block->suballocations[0].type == AllocationType::Free;
+}
+
+static bool tryAllocate(MemoryBlock* block, const VkMemoryRequirements& requirements, AllocationType type, VkDeviceSize granularity, VkDeviceSize& outOffset)
+{
+	std::vector<Suballocation>& subs = block->suballocations;
+
+	for (size_t i = 0; i < subs.size(); i++) {
+		const Suballocation& free = subs[i];
+		if (free.type != AllocationType::Free || free.size < requirements.size) {
+			continue;
+		}
+
+		VkDeviceSize offset = alignUp(free.offset, requirements.alignment);
+
+		if (granularity > 1 && i > 0) {
+			const Suballocation& prev = subs[i - 1];
+			if (onSamePage(prev.offset, prev.size, offset, granularity) && typesConflict(prev.type, type)) {
+				offset = alignUp(offset, granularity);
+			}
+		}
+
+		VkDeviceSize padding = offset - free.offset;
+		if (padding + requirements.size > free.size) {
+			continue;
+		}
+
+		if (granularity > 1 && i + 1 < subs.size()) {
+			const Suballocation& next = subs[i + 1];
+			if (onSamePage(offset, requirements.size, next.offset, granularity) && typesConflict(type, next.type)) {
+				continue;
+			}
+		}
+
+		VkDeviceSize remaining = free.size - padding - requirements.size;
+		VkDeviceSize freeOffset = free.offset;
+
+		std::vector<Suballocation> split;
+		if (padding > 0) {
+			split.push_back({ freeOffset, padding, AllocationType::Free });
+		}
+		split.push_back({ offset, requirements.size, type });
+		if (remaining > 0) {
+			split.push_back({ offset + requirements.size, remaining, AllocationType::Free });
+		}
+
+		subs.erase(subs.begin() + i);
+		subs.insert(subs.begin() + i, split.begin(), split.end());
+
+		outOffset = offset;
+		return true;
+	}
+
+	return false;
+}
+
+float HeapStats::fragmentation() const
+{
+	VkDeviceSize freeBytes = bytesAllocated - bytesUsed;
+	if (freeBytes == 0) {
+		return 0.0f;
+	}
+	return 1.0f - (float)largestFreeRange / (float)freeBytes;
+}
+
+MemoryAllocator::MemoryAllocator(const VDeleter<VkDevice>& device) :
+	device(device),
+	memProperties(),
+	bufferImageGranularity(1),
+	maxDeviceAllocationCount(0),
+	deviceAllocationCount(0)
+{
+}
+
+MemoryAllocator::~MemoryAllocator()
+{
+	destroy();
+}
+
+void MemoryAllocator::init(VkPhysicalDevice physicalDevice, VkDeviceSize preferredBlockSize)
+{
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+
+	bufferImageGranularity = properties.limits.bufferImageGranularity;
+	maxDeviceAllocationCount = properties.limits.maxMemoryAllocationCount;
+
+	blocks.resize(memProperties.memoryTypeCount);
+	blockSizes.resize(memProperties.memoryTypeCount);
+
+	for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+		VkDeviceSize heapSize = memProperties.memoryHeaps[memProperties.memoryTypes[i].heapIndex].size;
+		// Small heaps (e.g. the 256MB host visible device local one) get smaller blocks
+		blockSizes[i] = heapSize <= 1024ull * 1024 * 1024 ? std::min(preferredBlockSize, heapSize / 8) : preferredBlockSize;
+	}
+}
+
+void MemoryAllocator::destroy()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	for (auto& typeBlocks : blocks) {
+		for (auto& block : typeBlocks) {
+			if (block->mapped != nullptr) {
+				vkUnmapMemory(device, block->memory);
+			}
+			vkFreeMemory(device, block->memory, nullptr);
+			deviceAllocationCount--;
+		}
+		typeBlocks.clear();
+	}
+}
+
+uint32_t MemoryAllocator::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const
+{
+	for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+		if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+			return i;
+		}
+	}
+
+	throw std::runtime_error("failed to find suitable memory type!");
+}
+
+MemoryAllocation MemoryAllocator::allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, AllocationType type)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	uint32_t memoryTypeIndex = findMemoryType(requirements.memoryTypeBits, properties);
+	VkDeviceSize blockSize = blockSizes[memoryTypeIndex];
+
+	MemoryAllocation allocation;
+	allocation.memoryTypeIndex = memoryTypeIndex;
+	allocation.size = requirements.size;
+
+	if (requirements.size > blockSize / 2) {
+		MemoryBlock* block = createBlock(memoryTypeIndex, requirements.size, true);
+		block->suballocations[0].type = type;
+		allocation.memory = block->memory;
+		allocation.offset = 0;
+		allocation.block = block;
+		return allocation;
+	}
+
+	for (auto& block : blocks[memoryTypeIndex]) {
+		if (!block->dedicated && tryAllocate(block.get(), requirements, type, bufferImageGranularity, allocation.offset)) {
+			allocation.memory = block->memory;
+			allocation.block = block.get();
+			return allocation;
+		}
+	}
+
+	MemoryBlock* block = createBlock(memoryTypeIndex, blockSize, false);
+	if (!tryAllocate(block, requirements, type, bufferImageGranularity, allocation.offset)) {
+		throw std::runtime_error("failed to suballocate from a new memory block!");
+	}
+	allocation.memory = block->memory;
+	allocation.block = block;
+	return allocation;
+}
+
+void MemoryAllocator::free(MemoryAllocation& allocation)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	MemoryBlock* block = allocation.block;
+	VkDeviceSize offset = allocation.offset;
+	allocation = MemoryAllocation();
+
+	if (block == nullptr) {
+		return;
+	}
+
+	if (block->dedicated) {
+		destroyBlock(block);
+		return;
+	}
+
+	std::vector<Suballocation>& subs = block->suballocations;
+	auto it = std::lower_bound(subs.begin(), subs.end(), offset, [](const Suballocation& sub, VkDeviceSize value) {
+		return sub.offset < value;
+	});
+
+	if (it == subs.end() || it->offset != offset || it->type == AllocationType::Free) {
+		throw std::runtime_error("failed to free unknown suballocation!");
+	}
+
+	it->type = AllocationType::Free;
+
+	auto next = it + 1;
+	if (next != subs.end() && next->type == AllocationType::Free) {
+		it->size += next->size;
+		it = subs.erase(next) - 1;
+	}
+
+	if (it != subs.begin()) {
+		auto prev = it - 1;
+		if (prev->type == AllocationType::Free) {
+			prev->size += it->size;
+			subs.erase(it);
+		}
+	}
+
+	// Keep a single empty block per memory type around to avoid allocation churn
+	if (isEmpty(block)) {
+		for (const auto& other : blocks[block->memoryTypeIndex]) {
+			if (other.get() != block && !other->dedicated && isEmpty(other.get())) {
+				destroyBlock(block);
+				return;
+			}
+		}
+	}
+}
+
+MemoryBlock* MemoryAllocator::createBlock(uint32_t memoryTypeIndex, VkDeviceSize size, bool dedicated)
+{
+	VkMemoryAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = size;
+	allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+	VkDeviceMemory memory;
+	if (vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
+		throw std::runtime_error("failed to allocate device memory block!");
+	}
+	deviceAllocationCount++;
+
+	std::unique_ptr<MemoryBlock> block(new MemoryBlock());
+	block->memory = memory;
+	block->size = size;
+	block->memoryTypeIndex = memoryTypeIndex;
+	block->dedicated = dedicated;
+	block->mapped = nullptr;
+	block->suballocations.push_back({ 0, size, AllocationType::Free });
+
+	MemoryBlock* result = block.get();
+	blocks[memoryTypeIndex].push_back(std::move(block));
+	return result;
+}
+
+void MemoryAllocator::destroyBlock(MemoryBlock* block)
+{
+	auto& typeBlocks = blocks[block->memoryTypeIndex];
+	auto it = std::find_if(typeBlocks.begin(), typeBlocks.end(), [block](const std::unique_ptr<MemoryBlock>& b) {
+		return b.get() == block;
+	});
+
+	if (block->mapped != nullptr) {
+		vkUnmapMemory(device, block->memory);
+	}
+	vkFreeMemory(device, block->memory, nullptr);
+	deviceAllocationCount--;
+
+	typeBlocks.erase(it);
+}
+
+void* MemoryAllocator::map(const MemoryAllocation& allocation)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	MemoryBlock* block = allocation.block;
+	if (block->mapped == nullptr) {
+		if ((memProperties.memoryTypes[block->memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) == 0) {
+			throw std::runtime_error("failed to map memory that is not host visible!");
+		}
+		if (vkMapMemory(device, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped) != VK_SUCCESS) {
+			throw std::runtime_error("failed to map memory block!");
+		}
+	}
+
+	return static_cast<char*>(block->mapped) + allocation.offset;
+}
+
+AllocatorStats MemoryAllocator::getStats()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	AllocatorStats stats;
+	stats.deviceAllocationCount = deviceAllocationCount;
+	stats.maxDeviceAllocationCount = maxDeviceAllocationCount;
+	stats.heaps.resize(memProperties.memoryHeapCount);
+
+	for (uint32_t type = 0; type < blocks.size(); type++) {
+		HeapStats& heap = stats.heaps[memProperties.memoryTypes[type].heapIndex];
+
+		for (const auto& block : blocks[type]) {
+			heap.blockCount++;
+			heap.bytesAllocated += block->size;
+
+			for (const Suballocation& sub : block->suballocations) {
+				if (sub.type == AllocationType::Free) {
+					heap.freeRangeCount++;
+					heap.largestFreeRange = std::max(heap.largestFreeRange, sub.size);
+				}
+				else {
+					heap.allocationCount++;
+					heap.bytesUsed += sub.size;
+				}
+			}
+		}
+	}
+
+	return stats;
+}
+
+void MemoryAllocator::printStats(std::ostream& out)
+{
+	AllocatorStats stats = getStats();
+
+	out << "memory allocator: " << stats.deviceAllocationCount << " device allocations (limit " << stats.maxDeviceAllocationCount << ")" << std::endl;
+
+	for (size_t i = 0; i < stats.heaps.size(); i++) {
+		const HeapStats& heap = stats.heaps[i];
+		if (heap.blockCount == 0) {
+			continue;
+		}
+
+		bool deviceLocal = (memProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+
+		out << std::fixed << std::setprecision(2)
+			<< "  heap " << i << (deviceLocal ? " (device local)" : " (host)") << ": "
+			<< heap.blockCount << " blocks, "
+			<< heap.allocationCount << " allocations, "
+			<< heap.bytesUsed / (1024.0 * 1024.0) << " MiB used of "
+			<< heap.bytesAllocated / (1024.0 * 1024.0) << " MiB, "
+			<< heap.freeRangeCount << " free ranges, fragmentation "
+			<< heap.fragmentation() << std::endl;
+	}
+
+	out.unsetf(std::ios::floatfield);
+}
@@ -0,0 +1,123 @@
+#include "MeshCache.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+static const uint32_t MESH_CACHE_MAGIC = 0x48534d56; // "VMSH"
+static const uint32_t MESH_CACHE_VERSION = 3;
+
+struct MeshCacheHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t sourceHash;
+	uint64_t sourceSize;
+	uint32_t vertexStride;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t importFlags;
+	float boundsMin[3];
+	float boundsMax[3];
+	uint64_t vertexOffset;
+	uint64_t indexOffset;
+	uint64_t submeshOffset;
+	uint32_t submeshCount;
+	uint32_t submeshStride;
+};
+
+static_assert(sizeof(MeshCacheHeader) % 16 == 0, "mesh data must start aligned");
+
+bool MeshCache::open(const std::string& path, uint64_t sourceHash, uint64_t sourceSize, uint32_t importFlags)
+{
+	close();
+
+	if (!file.open(path) || file.size() < sizeof(MeshCacheHeader)) {
+		close();
+		return false;
+	}
+
+	MeshCacheHeader header;
+	memcpy(&header, file.data(), sizeof(header));
+
+	uint64_t vertexBytes = (uint64_t)header.vertexCount * sizeof(Vertex);
+	uint64_t indexBytes = (uint64_t)header.indexCount * sizeof(uint32_t);
+	uint64_t submeshBytes = (uint64_t)header.submeshCount * sizeof(Submesh);
+
+	if (header.magic != MESH_CACHE_MAGIC || header.version != MESH_CACHE_VERSION ||
+		header.vertexStride != sizeof(Vertex) || header.submeshStride != sizeof(Submesh) ||
+		header.sourceHash != sourceHash || header.sourceSize != sourceSize || header.importFlags != importFlags ||
+		header.vertexOffset % alignof(Vertex) != 0 || header.indexOffset % alignof(uint32_t) != 0 || header.submeshOffset % alignof(Submesh) != 0 ||
+		header.vertexOffset + vertexBytes > file.size() || header.indexOffset + indexBytes > file.size() || header.submeshOffset + submeshBytes > file.size()) {
+		close();
+		return false;
+	}
+
+	meshView.vertices = reinterpret_cast<const Vertex*>(file.data() + header.vertexOffset);
+	meshView.vertexCount = header.vertexCount;
+	meshView.indices = reinterpret_cast<const uint32_t*>(file.data() + header.indexOffset);
+	meshView.indexCount = header.indexCount;
+	meshView.submeshes = reinterpret_cast<const Submesh*>(file.data() + header.submeshOffset);
+	meshView.submeshCount = header.submeshCount;
+	meshView.bounds.min = glm::vec3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+	meshView.bounds.max = glm::vec3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+
+	return true;
+}
+
+void MeshCache::close()
+{
+	file.close();
+	meshView = MeshView();
+}
+
+bool MeshCache::write(const std::string& path, uint64_t sourceHash, uint64_t sourceSize, uint32_t importFlags, const MeshView& mesh)
+{
+	MeshCacheHeader header = {};
+	header.magic = MESH_CACHE_MAGIC;
+	header.version = MESH_CACHE_VERSION;
+	header.sourceHash = sourceHash;
+	header.sourceSize = sourceSize;
+	header.importFlags = importFlags;
+	header.vertexStride = sizeof(Vertex);
+	header.vertexCount = (uint32_t)mesh.vertexCount;
+	header.indexCount = (uint32_t)mesh.indexCount;
+	memcpy(header.boundsMin, &mesh.bounds.min, sizeof(header.boundsMin));
+	memcpy(header.boundsMax, &mesh.bounds.max, sizeof(header.boundsMax));
+	header.vertexOffset = sizeof(MeshCacheHeader);
+	header.indexOffset = header.vertexOffset + mesh.vertexCount * sizeof(Vertex);
+	header.submeshCount = (uint32_t)mesh.submeshCount;
+	header.submeshStride = sizeof(Submesh);
+
+	// Submeshes hold floats, keep them aligned behind the indices
+	uint64_t indexEnd = header.indexOffset + mesh.indexCount * sizeof(uint32_t);
+	header.submeshOffset = (indexEnd + alignof(Submesh) - 1) / alignof(Submesh) * alignof(Submesh);
+	static const char padding[16] = {};
+
+	// Written under a temporary name so a crash never leaves a truncated cache behind
+	std::string tempPath = path + ".tmp";
+	{
+		std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+		if (!out.is_open()) {
+			return false;
+		}
+
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		out.write(reinterpret_cast<const char*>(mesh.vertices), mesh.vertexCount * sizeof(Vertex));
+		out.write(reinterpret_cast<const char*>(mesh.indices), mesh.indexCount * sizeof(uint32_t));
+		out.write(padding, header.submeshOffset - indexEnd);
+		out.write(reinterpret_cast<const char*>(mesh.submeshes), mesh.submeshCount * sizeof(Submesh));
+
+		if (!out.good()) {
+			out.close();
+			std::remove(tempPath.c_str());
+			return false;
+		}
+	}
+
+	std::remove(path.c_str());
+	if (std::rename(tempPath.c_str(), path.c_str()) != 0) {
+		std::remove(tempPath.c_str());
+		return false;
+	}
+
+	return true;
+}
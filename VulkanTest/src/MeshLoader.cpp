@@ -0,0 +1,180 @@
+#include "Mesh.h"
+#include "ObjParser.h"
+#include "VertexHashMap.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include <tiny_obj_loader.h>
+
+static ObjData readTinyObj(const std::string& path)
+{
+	tinyobj::attrib_t attrib;
+	std::vector<tinyobj::shape_t> shapes;
+	std::vector<tinyobj::material_t> materials;
+	std::string err;
+
+	if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &err, path.c_str())) {
+		throw std::runtime_error(err);
+	}
+
+	ObjData obj;
+	obj.positions = std::move(attrib.vertices);
+	obj.normals = std::move(attrib.normals);
+	obj.texcoords = std::move(attrib.texcoords);
+
+	for (const auto& shape : shapes) {
+		ObjShape objShape;
+		objShape.name = shape.name;
+		objShape.indices.reserve(shape.mesh.indices.size());
+		for (const auto& index : shape.mesh.indices) {
+			objShape.indices.push_back({ index.vertex_index, index.normal_index, index.texcoord_index });
+		}
+		obj.shapes.push_back(std::move(objShape));
+	}
+
+	return obj;
+}
+
+Mesh MeshLoader::loadObj(const std::string& path, MeshLoadReport& report, ObjImporter importer)
+{
+	auto parseStart = std::chrono::steady_clock::now();
+
+	ObjData obj = importer == ObjImporter::TinyObj ? readTinyObj(path) : ObjParser::load(path, ThreadPool::shared());
+
+	auto buildStart = std::chrono::steady_clock::now();
+
+	size_t indexCount = 0;
+	for (const auto& shape : obj.shapes) {
+		indexCount += shape.indices.size();
+	}
+
+	Mesh mesh;
+	mesh.indices.reserve(indexCount);
+
+	VertexHashMap uniqueVertices(indexCount / 4);
+
+	for (const auto& shape : obj.shapes) {
+		Submesh submesh = {};
+		submesh.firstIndex = (uint32_t)mesh.indices.size();
+		submesh.indexCount = (uint32_t)shape.indices.size();
+
+		if (submesh.indexCount > 0) {
+			mesh.submeshes.push_back(submesh);
+		}
+
+		for (const auto& index : shape.indices) {
+			Vertex vertex = {};
+
+			vertex.pos = {
+				obj.positions[3 * index.vertex + 0],
+				obj.positions[3 * index.vertex + 1],
+				obj.positions[3 * index.vertex + 2]
+			};
+
+			if (index.normal >= 0)
+			{
+				vertex.normal = {
+					obj.normals[3 * index.normal + 0],
+					obj.normals[3 * index.normal + 1],
+					obj.normals[3 * index.normal + 2]
+				};
+			}
+
+			if (index.texcoord >= 0)
+			{
+				vertex.texCoord = {
+					obj.texcoords[2 * index.texcoord + 0],
+					1.0f - obj.texcoords[2 * index.texcoord + 1]
+				};
+			}
+
+			mesh.indices.push_back(uniqueVertices.findOrInsert(vertex, mesh.vertices));
+		}
+	}
+
+	mesh.bounds = computeBounds(mesh.vertices);
+
+	for (Submesh& submesh : mesh.submeshes) {
+		computeSubmeshBounds(mesh.vertices, mesh.indices, submesh);
+	}
+
+	auto buildEnd = std::chrono::steady_clock::now();
+
+	report.sourceVertexCount = indexCount;
+	report.uniqueVertexCount = mesh.vertices.size();
+	report.parseMilliseconds = std::chrono::duration<double, std::milli>(buildStart - parseStart).count();
+	report.buildMilliseconds = std::chrono::duration<double, std::milli>(buildEnd - buildStart).count();
+
+	return mesh;
+}
+
+Bounds MeshLoader::computeBounds(const std::vector<Vertex>& vertices)
+{
+	if (vertices.empty()) {
+		return Bounds();
+	}
+
+	Bounds bounds = { vertices[0].pos, vertices[0].pos };
+	for (const Vertex& vertex : vertices) {
+		bounds.min = glm::min(bounds.min, vertex.pos);
+		bounds.max = glm::max(bounds.max, vertex.pos);
+	}
+	return bounds;
+}
+
+void MeshLoader::computeSubmeshBounds(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, Submesh& submesh)
+{
+	const uint32_t* first = indices.data() + submesh.firstIndex;
+	const uint32_t* last = first + submesh.indexCount;
+
+	if (first == last) {
+		submesh.bounds = Bounds();
+		submesh.sphere = glm::vec4(0.0f);
+		return;
+	}
+
+	Bounds bounds = { vertices[*first].pos, vertices[*first].pos };
+	for (const uint32_t* index = first; index != last; index++) {
+		bounds.min = glm::min(bounds.min, vertices[*index].pos);
+		bounds.max = glm::max(bounds.max, vertices[*index].pos);
+	}
+
+	// Centered on the box, but only as large as the farthest vertex, which is tighter than the box's corners
+	glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+	float radiusSquared = 0.0f;
+	for (const uint32_t* index = first; index != last; index++) {
+		glm::vec3 offset = vertices[*index].pos - center;
+		radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+	}
+
+	submesh.bounds = bounds;
+	submesh.sphere = glm::vec4(center, std::sqrt(radiusSquared));
+}
+
+MeshView Mesh::view() const
+{
+	MeshView view;
+	view.vertices = vertices.data();
+	view.vertexCount = vertices.size();
+	view.indices = indices.data();
+	view.indexCount = indices.size();
+	view.submeshes = submeshes.data();
+	view.submeshCount = submeshes.size();
+	view.bounds = bounds;
+	return view;
+}
+
+void MeshLoadReport::print(const std::string& path) const
+{
+	std::cout << std::fixed << std::setprecision(2)
+		<< path << ": " << uniqueVertexCount << " unique vertices from " << sourceVertexCount << " indices ("
+		<< (uniqueVertexCount > 0 ? (double)sourceVertexCount / uniqueVertexCount : 0.0) << "x), "
+		<< bytesSaved() / (1024.0 * 1024.0) << " MiB saved, parsed in "
+		<< parseMilliseconds << " ms, indexed in " << buildMilliseconds << " ms" << std::endl;
+	std::cout.unsetf(std::ios::floatfield);
+}
@@ -0,0 +1,356 @@
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+
+// Tuning from Tom Forsyth's "Linear-Speed Vertex Cache Optimisation"
+static const uint32_t FORSYTH_CACHE_SIZE = 32;
+static const float CACHE_DECAY_POWER = 1.5f;
+static const float LAST_TRIANGLE_SCORE = 0.75f;
+static const float VALENCE_BOOST_SCALE = 2.0f;
+static const float VALENCE_BOOST_POWER = 0.5f;
+
+static const uint32_t NO_TRIANGLE = 0xffffffffu;
+
+static float forsythVertexScore(int cachePosition, uint32_t liveTriangles)
+{
+	if (liveTriangles == 0) {
+		return -1.0f;
+	}
+
+	float score = 0.0f;
+	if (cachePosition >= 0) {
+		// The last triangle's vertices get a fixed score, so the next triangle does not simply reuse its edge
+		if (cachePosition < 3) {
+			score = LAST_TRIANGLE_SCORE;
+		}
+		else {
+			score = std::pow(1.0f - (cachePosition - 3) / (float)(FORSYTH_CACHE_SIZE - 3), CACHE_DECAY_POWER);
+		}
+	}
+
+	// Favour vertices with few triangles left, so they are finished off instead of stranded
+	return score + VALENCE_BOOST_SCALE * std::pow((float)liveTriangles, -VALENCE_BOOST_POWER);
+}
+
+// Maps the vertices referenced by an index range to 0..n-1, so per-vertex state scales with the range.
+static size_t remapLocal(const uint32_t* indices, size_t indexCount, std::vector<uint32_t>& unique, std::vector<uint32_t>& local)
+{
+	unique.assign(indices, indices + indexCount);
+	std::sort(unique.begin(), unique.end());
+	unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+
+	local.resize(indexCount);
+	for (size_t i = 0; i < indexCount; i++) {
+		local[i] = (uint32_t)(std::lower_bound(unique.begin(), unique.end(), indices[i]) - unique.begin());
+	}
+
+	return unique.size();
+}
+
+void MeshOptimizer::optimize(Mesh& mesh, bool overdraw, MeshOptimizeReport& report)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	report.before = analyzeVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size());
+	report.overdrawClusters = 0;
+
+	// Submeshes are drawn on their own, so triangles never move between them
+	for (const Submesh& submesh : mesh.submeshes) {
+		uint32_t* indices = mesh.indices.data() + submesh.firstIndex;
+
+		optimizeVertexCache(indices, submesh.indexCount);
+
+		if (overdraw) {
+			report.overdrawClusters += optimizeOverdraw(indices, submesh.indexCount, mesh.vertices.data());
+		}
+	}
+
+	optimizeVertexFetch(mesh.vertices, mesh.indices);
+
+	report.after = analyzeVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size());
+	report.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void MeshOptimizer::optimizeVertexCache(uint32_t* indices, size_t indexCount)
+{
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount < 2) {
+		return;
+	}
+
+	std::vector<uint32_t> unique;
+	std::vector<uint32_t> local;
+	size_t vertexCount = remapLocal(indices, triangleCount * 3, unique, local);
+
+	// Triangles using each vertex, the first liveTriangles[v] entries of its run are not emitted yet
+	std::vector<uint32_t> liveTriangles(vertexCount, 0);
+	for (size_t i = 0; i < triangleCount * 3; i++) {
+		liveTriangles[local[i]]++;
+	}
+
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++) {
+		adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+	}
+
+	std::vector<uint32_t> adjacency(triangleCount * 3);
+	{
+		std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (size_t i = 0; i < triangleCount * 3; i++) {
+			adjacency[fill[local[i]]++] = (uint32_t)(i / 3);
+		}
+	}
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> vertexScore(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++) {
+		vertexScore[v] = forsythVertexScore(-1, liveTriangles[v]);
+	}
+
+	std::vector<bool> emitted(triangleCount, false);
+
+	uint32_t best = NO_TRIANGLE;
+	float bestScore = -1.0f;
+	for (size_t t = 0; t < triangleCount; t++) {
+		float score = vertexScore[local[t * 3]] + vertexScore[local[t * 3 + 1]] + vertexScore[local[t * 3 + 2]];
+		if (score > bestScore) {
+			bestScore = score;
+			best = (uint32_t)t;
+		}
+	}
+
+	std::vector<uint32_t> cache;
+	std::vector<uint32_t> newCache;
+	cache.reserve(FORSYTH_CACHE_SIZE + 3);
+	newCache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+	std::vector<uint32_t> output(triangleCount * 3);
+	size_t cursor = 0;
+
+	for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++) {
+		// Nothing in the cache has triangles left, restart from the first triangle not drawn yet
+		if (best == NO_TRIANGLE) {
+			while (emitted[cursor]) {
+				cursor++;
+			}
+			best = (uint32_t)cursor;
+		}
+
+		uint32_t triangle = best;
+		const uint32_t* corners = &local[triangle * 3];
+		emitted[triangle] = true;
+		std::copy(corners, corners + 3, &output[emittedCount * 3]);
+
+		newCache.clear();
+		for (int k = 0; k < 3; k++) {
+			uint32_t v = corners[k];
+
+			uint32_t* run = &adjacency[adjacencyOffsets[v]];
+			uint32_t* last = run + liveTriangles[v] - 1;
+			*std::find(run, last + 1, triangle) = *last;
+			liveTriangles[v]--;
+
+			if (std::find(newCache.begin(), newCache.end(), v) == newCache.end()) {
+				newCache.push_back(v);
+			}
+		}
+
+		for (uint32_t v : cache) {
+			if (v != corners[0] && v != corners[1] && v != corners[2]) {
+				newCache.push_back(v);
+			}
+		}
+
+		// Rescore every vertex that moved in or out of the cache, then the triangles they still have
+		for (size_t i = 0; i < newCache.size(); i++) {
+			uint32_t v = newCache[i];
+			cachePosition[v] = i < FORSYTH_CACHE_SIZE ? (int)i : -1;
+			vertexScore[v] = forsythVertexScore(cachePosition[v], liveTriangles[v]);
+		}
+
+		best = NO_TRIANGLE;
+		bestScore = -1.0f;
+		for (uint32_t v : newCache) {
+			const uint32_t* run = &adjacency[adjacencyOffsets[v]];
+			for (uint32_t i = 0; i < liveTriangles[v]; i++) {
+				uint32_t t = run[i];
+				float score = vertexScore[local[t * 3]] + vertexScore[local[t * 3 + 1]] + vertexScore[local[t * 3 + 2]];
+				if (score > bestScore) {
+					bestScore = score;
+					best = t;
+				}
+			}
+		}
+
+		if (newCache.size() > FORSYTH_CACHE_SIZE) {
+			newCache.resize(FORSYTH_CACHE_SIZE);
+		}
+		cache.swap(newCache);
+	}
+
+	for (size_t i = 0; i < output.size(); i++) {
+		indices[i] = unique[output[i]];
+	}
+}
+
+uint32_t MeshOptimizer::optimizeOverdraw(uint32_t* indices, size_t indexCount, const Vertex* vertices)
+{
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount < 2) {
+		return triangleCount > 0 ? 1 : 0;
+	}
+
+	std::vector<uint32_t> unique;
+	std::vector<uint32_t> local;
+	size_t vertexCount = remapLocal(indices, triangleCount * 3, unique, local);
+
+	// A triangle missing the cache on all three vertices starts a new cluster, moving clusters
+	// around then costs about as many transforms as the cache already paid for
+	std::vector<uint32_t> clusterStarts;
+	std::vector<uint32_t> timestamps(vertexCount, 0);
+	uint32_t time = ANALYSIS_CACHE_SIZE + 1;
+
+	for (size_t t = 0; t < triangleCount; t++) {
+		int misses = 0;
+		for (int k = 0; k < 3; k++) {
+			uint32_t v = local[t * 3 + k];
+			if (time - timestamps[v] > ANALYSIS_CACHE_SIZE) {
+				timestamps[v] = time++;
+				misses++;
+			}
+		}
+
+		if (t == 0 || misses == 3) {
+			clusterStarts.push_back((uint32_t)t);
+		}
+	}
+
+	uint32_t clusterCount = (uint32_t)clusterStarts.size();
+	clusterStarts.push_back((uint32_t)triangleCount);
+
+	if (clusterCount < 2) {
+		return clusterCount;
+	}
+
+	// Area weighted centroid and normal of each cluster, and the centroid of the whole range
+	std::vector<glm::vec3> centroids(clusterCount);
+	std::vector<glm::vec3> normals(clusterCount);
+	glm::vec3 meshCentroid(0.0f);
+	float meshArea = 0.0f;
+
+	for (uint32_t c = 0; c < clusterCount; c++) {
+		glm::vec3 centroid(0.0f);
+		glm::vec3 normal(0.0f);
+		float area = 0.0f;
+
+		for (uint32_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++) {
+			const glm::vec3& a = vertices[indices[t * 3]].pos;
+			const glm::vec3& b = vertices[indices[t * 3 + 1]].pos;
+			const glm::vec3& p = vertices[indices[t * 3 + 2]].pos;
+
+			glm::vec3 cross = glm::cross(b - a, p - a);
+			float triangleArea = glm::length(cross);
+
+			centroid += (a + b + p) * (triangleArea / 3.0f);
+			normal += cross;
+			area += triangleArea;
+		}
+
+		meshCentroid += centroid;
+		meshArea += area;
+		centroids[c] = area > 0.0f ? centroid / area : glm::vec3(vertices[indices[clusterStarts[c] * 3]].pos);
+		normals[c] = normal;
+	}
+
+	if (meshArea > 0.0f) {
+		meshCentroid /= meshArea;
+	}
+
+	// Clusters further out along their own normal are more likely to occlude the rest
+	std::vector<float> sortKeys(clusterCount);
+	for (uint32_t c = 0; c < clusterCount; c++) {
+		float length = glm::length(normals[c]);
+		sortKeys[c] = length > 0.0f ? glm::dot(centroids[c] - meshCentroid, normals[c] / length) : 0.0f;
+	}
+
+	std::vector<uint32_t> order(clusterCount);
+	for (uint32_t c = 0; c < clusterCount; c++) {
+		order[c] = c;
+	}
+	std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return sortKeys[a] > sortKeys[b]; });
+
+	std::vector<uint32_t> sorted(indices, indices + triangleCount * 3);
+	size_t written = 0;
+	for (uint32_t c : order) {
+		size_t first = clusterStarts[c] * 3;
+		size_t last = clusterStarts[c + 1] * 3;
+		std::copy(indices + first, indices + last, sorted.begin() + written);
+		written += last - first;
+	}
+	std::copy(sorted.begin(), sorted.end(), indices);
+
+	return clusterCount;
+}
+
+void MeshOptimizer::optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+	const uint32_t unused = 0xffffffffu;
+	std::vector<uint32_t> remap(vertices.size(), unused);
+
+	std::vector<Vertex> reordered;
+	reordered.reserve(vertices.size());
+
+	for (uint32_t& index : indices) {
+		if (remap[index] == unused) {
+			remap[index] = (uint32_t)reordered.size();
+			reordered.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+
+	vertices.swap(reordered);
+}
+
+VertexCacheStats MeshOptimizer::analyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize)
+{
+	VertexCacheStats stats;
+	if (indexCount < 3 || vertexCount == 0) {
+		return stats;
+	}
+
+	// A vertex is still cached while fewer than cacheSize other vertices were transformed after it
+	std::vector<uint32_t> timestamps(vertexCount, 0);
+	uint32_t time = cacheSize + 1;
+	size_t misses = 0;
+	size_t referenced = 0;
+
+	for (size_t i = 0; i < indexCount; i++) {
+		uint32_t v = indices[i];
+		if (timestamps[v] == 0) {
+			referenced++;
+		}
+		if (time - timestamps[v] > cacheSize) {
+			timestamps[v] = time++;
+			misses++;
+		}
+	}
+
+	stats.acmr = (double)misses / (indexCount / 3);
+	stats.atvr = (double)misses / referenced;
+	return stats;
+}
+
+void MeshOptimizeReport::print(const std::string& path) const
+{
+	std::cout << std::fixed << std::setprecision(3)
+		<< path << ": ACMR " << before.acmr << " -> " << after.acmr
+		<< ", ATVR " << before.atvr << " -> " << after.atvr;
+	if (overdrawClusters > 0) {
+		std::cout << ", " << overdrawClusters << " clusters sorted for overdraw";
+	}
+	std::cout << std::setprecision(2) << ", optimized in " << milliseconds << " ms" << std::endl;
+	std::cout.unsetf(std::ios::floatfield);
+}
@@ -0,0 +1,92 @@
+#include "MipChain.h"
+#include <algorithm>
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define MIP_CHAIN_SSE2
+#endif
+
+uint32_t MipChain::levelCount(uint32_t width, uint32_t height)
+{
+	uint32_t levels = 1;
+	uint32_t size = std::max(width, height);
+	while (size > 1) {
+		size >>= 1;
+		levels++;
+	}
+	return levels;
+}
+
+std::vector<MipLevel> MipChain::layout(uint32_t width, uint32_t height, uint32_t levels)
+{
+	std::vector<MipLevel> chain(levels);
+
+	size_t offset = 0;
+	for (uint32_t i = 0; i < levels; i++) {
+		chain[i].width = width;
+		chain[i].height = height;
+		chain[i].offset = offset;
+		chain[i].size = (size_t)width * height * 4;
+
+		// Keep every level at a 16 byte boundary, which satisfies any buffer to image copy alignment for RGBA8
+		offset += (chain[i].size + 15) & ~(size_t)15;
+
+		width = std::max(width / 2, 1u);
+		height = std::max(height / 2, 1u);
+	}
+
+	return chain;
+}
+
+void MipChain::generate(uint8_t* chain, const std::vector<MipLevel>& levels)
+{
+	for (size_t i = 1; i < levels.size(); i++) {
+		const MipLevel& src = levels[i - 1];
+		downsample(chain + src.offset, src.width, src.height, chain + levels[i].offset);
+	}
+}
+
+void MipChain::downsample(const uint8_t* src, uint32_t srcWidth, uint32_t srcHeight, uint8_t* dst)
+{
+	uint32_t dstWidth = std::max(srcWidth / 2, 1u);
+	uint32_t dstHeight = std::max(srcHeight / 2, 1u);
+
+	for (uint32_t y = 0; y < dstHeight; y++) {
+		const uint8_t* row0 = src + (size_t)std::min(y * 2, srcHeight - 1) * srcWidth * 4;
+		const uint8_t* row1 = src + (size_t)std::min(y * 2 + 1, srcHeight - 1) * srcWidth * 4;
+		uint8_t* out = dst + (size_t)y * dstWidth * 4;
+
+		uint32_t x = 0;
+
+#ifdef MIP_CHAIN_SSE2
+		// Two output texels per iteration while both have a full 2x2 footprint
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i rounding = _mm_set1_epi16(2);
+
+		for (; x + 1 < dstWidth && x * 2 + 3 < srcWidth; x += 2) {
+			__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 8));
+			__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 8));
+
+			__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+			__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+
+			lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+			hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+
+			__m128i sum = _mm_unpacklo_epi64(lo, hi);
+			sum = _mm_srli_epi16(_mm_add_epi16(sum, rounding), 2);
+
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(out + x * 4), _mm_packus_epi16(sum, sum));
+		}
+#endif
+
+		for (; x < dstWidth; x++) {
+			uint32_t x0 = std::min(x * 2, srcWidth - 1) * 4;
+			uint32_t x1 = std::min(x * 2 + 1, srcWidth - 1) * 4;
+
+			for (uint32_t c = 0; c < 4; c++) {
+				out[x * 4 + c] = (uint8_t)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+			}
+		}
+	}
+}
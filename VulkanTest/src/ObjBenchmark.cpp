@@ -0,0 +1,77 @@
+#include "ObjBenchmark.h"
+#include "Mesh.h"
+#include "ObjParser.h"
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static const char* SYNTHETIC_PATH = "models/synthetic_benchmark.obj";
+
+static bool sameMesh(const Mesh& a, const Mesh& b)
+{
+	if (a.vertices.size() != b.vertices.size() || a.indices != b.indices || a.submeshes.size() != b.submeshes.size()) {
+		return false;
+	}
+
+	// Vertex has padding-free float members, so a byte compare is exact
+	if (memcmp(a.vertices.data(), b.vertices.data(), a.vertices.size() * sizeof(Vertex)) != 0) {
+		return false;
+	}
+
+	for (size_t i = 0; i < a.submeshes.size(); i++) {
+		if (a.submeshes[i].firstIndex != b.submeshes[i].firstIndex || a.submeshes[i].indexCount != b.submeshes[i].indexCount) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool benchmarkModel(const std::string& path)
+{
+	MeshLoadReport tinyObjReport;
+	Mesh tinyObjMesh = MeshLoader::loadObj(path, tinyObjReport, ObjImporter::TinyObj);
+
+	MeshLoadReport parallelReport;
+	Mesh parallelMesh = MeshLoader::loadObj(path, parallelReport, ObjImporter::Parallel);
+
+	bool same = sameMesh(tinyObjMesh, parallelMesh);
+
+	std::cout << std::fixed << std::setprecision(2)
+		<< path << ": " << tinyObjMesh.indices.size() / 3 << " triangles" << std::endl
+		<< "  tinyobj  parsed in " << std::setw(10) << tinyObjReport.parseMilliseconds << " ms, indexed in " << tinyObjReport.buildMilliseconds << " ms" << std::endl
+		<< "  parallel parsed in " << std::setw(10) << parallelReport.parseMilliseconds << " ms, indexed in " << parallelReport.buildMilliseconds << " ms ("
+		<< (parallelReport.parseMilliseconds > 0.0 ? tinyObjReport.parseMilliseconds / parallelReport.parseMilliseconds : 0.0) << "x), "
+		<< (same ? "identical meshes" : "MESHES DIFFER") << std::endl;
+	std::cout.unsetf(std::ios::floatfield);
+
+	return same;
+}
+
+bool ObjBenchmark::run(uint32_t syntheticMegabytes)
+{
+	std::vector<std::string> paths = { "models/cat.obj", "models/Farmhouse.obj" };
+
+	if (syntheticMegabytes > 0) {
+		std::cout << "writing " << syntheticMegabytes << " MiB " << SYNTHETIC_PATH << "..." << std::endl;
+		if (!ObjParser::writeSynthetic(SYNTHETIC_PATH, (uint64_t)syntheticMegabytes << 20)) {
+			std::cerr << "failed to write " << SYNTHETIC_PATH << std::endl;
+			return false;
+		}
+		paths.push_back(SYNTHETIC_PATH);
+	}
+
+	bool same = true;
+	for (const std::string& path : paths) {
+		same &= benchmarkModel(path);
+	}
+
+	if (syntheticMegabytes > 0) {
+		remove(SYNTHETIC_PATH);
+	}
+
+	return same;
+}
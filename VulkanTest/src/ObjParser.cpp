@@ -0,0 +1,511 @@
+#include "ObjParser.h"
+#include "MappedFile.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+// Smaller chunks do not amortize the merge, larger ones balance poorly across threads
+static const size_t MIN_CHUNK_BYTES = 1 << 20;
+static const uint32_t CHUNKS_PER_THREAD = 16;
+
+static const double POWERS_OF_TEN[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+enum ObjAttribute {
+	OBJ_VERTEX,
+	OBJ_NORMAL,
+	OBJ_TEXCOORD
+};
+
+// A negative OBJ index counts back from the attributes read so far, which a chunk only
+// knows relative to its own start. These are rebased once all chunks are parsed.
+struct RelativeIndex {
+	uint32_t shape;
+	uint32_t corner;
+	ObjAttribute attribute;
+};
+
+struct ObjChunk {
+	std::vector<float> positions;
+	std::vector<float> normals;
+	std::vector<float> texcoords;
+	// shapes[0] continues whichever shape is open where the chunk starts
+	std::vector<ObjShape> shapes;
+	std::vector<RelativeIndex> relativeIndices;
+	std::string error;
+
+	size_t positionBase = 0;
+	size_t normalBase = 0;
+	size_t texcoordBase = 0;
+	// Merged shape and index offset each of the chunk's shapes is copied to
+	std::vector<std::pair<size_t, size_t>> targets;
+};
+
+static inline bool isSpace(char c)
+{
+	return c == ' ' || c == '\t';
+}
+
+static inline bool isDigit(char c)
+{
+	return (unsigned)(c - '0') < 10;
+}
+
+static inline const char* skipSpaces(const char* p, const char* end)
+{
+	while (p < end && isSpace(*p)) {
+		p++;
+	}
+	return p;
+}
+
+// Decimal float without strtod's locale handling: up to 19 significant digits are gathered
+// into an integer and scaled by an exact power of ten. Missing numbers read as 0, like tinyobj.
+static const char* parseFloat(const char* p, const char* end, float& value)
+{
+	p = skipSpaces(p, end);
+
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) {
+		negative = *p == '-';
+		p++;
+	}
+
+	uint64_t mantissa = 0;
+	int exponent = 0;
+	int digits = 0;
+
+	for (; p < end && isDigit(*p); p++) {
+		if (digits < 19) {
+			mantissa = mantissa * 10 + (*p - '0');
+			digits += mantissa != 0;
+		}
+		else {
+			exponent++;
+		}
+	}
+
+	if (p < end && *p == '.') {
+		for (p++; p < end && isDigit(*p); p++) {
+			if (digits < 19) {
+				mantissa = mantissa * 10 + (*p - '0');
+				digits += mantissa != 0;
+				exponent--;
+			}
+		}
+	}
+
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		const char* q = p + 1;
+		bool negativeExponent = false;
+		if (q < end && (*q == '-' || *q == '+')) {
+			negativeExponent = *q == '-';
+			q++;
+		}
+
+		if (q < end && isDigit(*q)) {
+			int parsed = 0;
+			for (; q < end && isDigit(*q); q++) {
+				if (parsed < 10000) {
+					parsed = parsed * 10 + (*q - '0');
+				}
+			}
+			exponent += negativeExponent ? -parsed : parsed;
+			p = q;
+		}
+	}
+
+	double result = (double)mantissa;
+	if (exponent < 0) {
+		result = -exponent <= 22 ? result / POWERS_OF_TEN[-exponent] : result * std::pow(10.0, exponent);
+	}
+	else if (exponent > 0) {
+		result = exponent <= 22 ? result * POWERS_OF_TEN[exponent] : result * std::pow(10.0, exponent);
+	}
+
+	value = (float)(negative ? -result : result);
+	return p;
+}
+
+static const char* parseInt(const char* p, const char* end, int64_t& value, bool& present)
+{
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) {
+		negative = *p == '-';
+		p++;
+	}
+
+	present = p < end && isDigit(*p);
+
+	int64_t parsed = 0;
+	for (; p < end && isDigit(*p); p++) {
+		if (parsed < INT32_MAX) {
+			parsed = parsed * 10 + (*p - '0');
+		}
+	}
+
+	value = negative ? -parsed : parsed;
+	return p;
+}
+
+// Converts a one based or negative OBJ index to a zero based one, relative ones to the chunk.
+static bool resolveIndex(int64_t value, size_t localCount, int32_t& index, bool& relative)
+{
+	if (value > 0) {
+		index = (int32_t)std::min<int64_t>(value - 1, INT32_MAX);
+		relative = false;
+		return true;
+	}
+	if (value < 0) {
+		index = (int32_t)std::max<int64_t>((int64_t)localCount + value, INT32_MIN);
+		relative = true;
+		return true;
+	}
+	return false;
+}
+
+static void parseFace(const char* p, const char* end, ObjChunk& chunk, std::vector<ObjIndex>& face, std::vector<uint8_t>& faceRelative)
+{
+	face.clear();
+	faceRelative.clear();
+
+	for (;;) {
+		p = skipSpaces(p, end);
+		if (p >= end || *p == '\r') {
+			break;
+		}
+
+		ObjIndex corner = { -1, -1, -1 };
+		uint8_t relative = 0;
+		int64_t value;
+		bool present;
+		bool isRelative;
+
+		p = parseInt(p, end, value, present);
+		if (!present || !resolveIndex(value, chunk.positions.size() / 3, corner.vertex, isRelative)) {
+			chunk.error = "malformed face in OBJ file!";
+			return;
+		}
+		relative |= isRelative ? 1 << OBJ_VERTEX : 0;
+
+		if (p < end && *p == '/') {
+			p = parseInt(p + 1, end, value, present);
+			if (present) {
+				if (!resolveIndex(value, chunk.texcoords.size() / 2, corner.texcoord, isRelative)) {
+					chunk.error = "malformed face in OBJ file!";
+					return;
+				}
+				relative |= isRelative ? 1 << OBJ_TEXCOORD : 0;
+			}
+
+			if (p < end && *p == '/') {
+				p = parseInt(p + 1, end, value, present);
+				if (present) {
+					if (!resolveIndex(value, chunk.normals.size() / 3, corner.normal, isRelative)) {
+						chunk.error = "malformed face in OBJ file!";
+						return;
+					}
+					relative |= isRelative ? 1 << OBJ_NORMAL : 0;
+				}
+			}
+		}
+
+		if (p < end && !isSpace(*p) && *p != '\r') {
+			chunk.error = "malformed face in OBJ file!";
+			return;
+		}
+
+		face.push_back(corner);
+		faceRelative.push_back(relative);
+	}
+
+	// Fan triangulation, the same triangles tinyobj emits
+	ObjShape& shape = chunk.shapes.back();
+	uint32_t shapeIndex = (uint32_t)chunk.shapes.size() - 1;
+
+	for (size_t k = 2; k < face.size(); k++) {
+		size_t corners[3] = { 0, k - 1, k };
+
+		for (size_t c : corners) {
+			for (int attribute = OBJ_VERTEX; attribute <= OBJ_TEXCOORD; attribute++) {
+				if (faceRelative[c] & (1 << attribute)) {
+					chunk.relativeIndices.push_back({ shapeIndex, (uint32_t)shape.indices.size(), (ObjAttribute)attribute });
+				}
+			}
+			shape.indices.push_back(face[c]);
+		}
+	}
+}
+
+static std::string parseName(const char* p, const char* end)
+{
+	p = skipSpaces(p, end);
+	const char* nameEnd = p;
+	while (nameEnd < end && !isSpace(*nameEnd) && *nameEnd != '\r') {
+		nameEnd++;
+	}
+	return std::string(p, nameEnd);
+}
+
+static void parseChunk(const char* p, const char* end, ObjChunk& chunk)
+{
+	chunk.shapes.emplace_back();
+
+	std::vector<ObjIndex> face;
+	std::vector<uint8_t> faceRelative;
+
+	while (p < end && chunk.error.empty()) {
+		const char* lineEnd = (const char*)memchr(p, '\n', end - p);
+		if (lineEnd == nullptr) {
+			lineEnd = end;
+		}
+
+		const char* q = skipSpaces(p, lineEnd);
+
+		if (lineEnd - q >= 2) {
+			if (q[0] == 'v' && isSpace(q[1])) {
+				float xyz[3];
+				q = parseFloat(q + 2, lineEnd, xyz[0]);
+				q = parseFloat(q, lineEnd, xyz[1]);
+				parseFloat(q, lineEnd, xyz[2]);
+				chunk.positions.insert(chunk.positions.end(), xyz, xyz + 3);
+			}
+			else if (q[0] == 'v' && q[1] == 'n' && lineEnd - q >= 3 && isSpace(q[2])) {
+				float xyz[3];
+				q = parseFloat(q + 3, lineEnd, xyz[0]);
+				q = parseFloat(q, lineEnd, xyz[1]);
+				parseFloat(q, lineEnd, xyz[2]);
+				chunk.normals.insert(chunk.normals.end(), xyz, xyz + 3);
+			}
+			else if (q[0] == 'v' && q[1] == 't' && lineEnd - q >= 3 && isSpace(q[2])) {
+				float uv[2];
+				q = parseFloat(q + 3, lineEnd, uv[0]);
+				parseFloat(q, lineEnd, uv[1]);
+				chunk.texcoords.insert(chunk.texcoords.end(), uv, uv + 2);
+			}
+			else if (q[0] == 'f' && isSpace(q[1])) {
+				parseFace(q + 2, lineEnd, chunk, face, faceRelative);
+			}
+			else if ((q[0] == 'o' || q[0] == 'g') && isSpace(q[1])) {
+				chunk.shapes.emplace_back();
+				chunk.shapes.back().name = parseName(q + 2, lineEnd);
+			}
+		}
+
+		p = lineEnd + 1;
+	}
+}
+
+ObjData ObjParser::load(const std::string& path, ThreadPool& pool)
+{
+	MappedFile file;
+	if (!file.open(path)) {
+		throw std::runtime_error("failed to open " + path + "!");
+	}
+
+	return parse(file.data(), file.size(), pool);
+}
+
+ObjData ObjParser::parse(const char* data, size_t size, ThreadPool& pool)
+{
+	uint32_t chunkCount = (uint32_t)std::max<size_t>(1, std::min<size_t>(size / MIN_CHUNK_BYTES, (pool.size() + 1) * CHUNKS_PER_THREAD));
+
+	// Chunks start right after a line break, so no line is split between two of them
+	std::vector<size_t> starts(chunkCount + 1, size);
+	starts[0] = 0;
+	for (uint32_t i = 1; i < chunkCount; i++) {
+		size_t guess = std::max(size / chunkCount * i, starts[i - 1]);
+		const char* lineEnd = (const char*)memchr(data + guess, '\n', size - guess);
+		starts[i] = lineEnd != nullptr ? lineEnd + 1 - data : size;
+	}
+
+	std::vector<ObjChunk> chunks(chunkCount);
+
+	pool.parallelFor(chunkCount, [&](uint32_t i) {
+		PROFILE_SCOPE("ObjParser::parseChunk");
+		parseChunk(data + starts[i], data + starts[i + 1], chunks[i]);
+	});
+
+	for (const ObjChunk& chunk : chunks) {
+		if (!chunk.error.empty()) {
+			throw std::runtime_error(chunk.error);
+		}
+	}
+
+	// Lay out the merged arrays: attribute bases of every chunk, and which merged shape each chunk shape extends
+	size_t positionCount = 0;
+	size_t normalCount = 0;
+	size_t texcoordCount = 0;
+	std::vector<size_t> shapeSizes;
+	std::vector<std::string> shapeNames;
+
+	for (ObjChunk& chunk : chunks) {
+		chunk.positionBase = positionCount;
+		chunk.normalBase = normalCount;
+		chunk.texcoordBase = texcoordCount;
+		positionCount += chunk.positions.size() / 3;
+		normalCount += chunk.normals.size() / 3;
+		texcoordCount += chunk.texcoords.size() / 2;
+
+		for (size_t k = 0; k < chunk.shapes.size(); k++) {
+			const ObjShape& shape = chunk.shapes[k];
+
+			if (k == 0 && !shapeSizes.empty()) {
+				chunk.targets.push_back({ shapeSizes.size() - 1, shapeSizes.back() });
+				shapeSizes.back() += shape.indices.size();
+			}
+			else {
+				chunk.targets.push_back({ shapeSizes.size(), 0 });
+				shapeSizes.push_back(shape.indices.size());
+				shapeNames.push_back(shape.name);
+			}
+		}
+	}
+
+	ObjData obj;
+	obj.positions.resize(positionCount * 3);
+	obj.normals.resize(normalCount * 3);
+	obj.texcoords.resize(texcoordCount * 2);
+	obj.shapes.resize(shapeSizes.size());
+	for (size_t i = 0; i < shapeSizes.size(); i++) {
+		obj.shapes[i].name = shapeNames[i];
+		obj.shapes[i].indices.resize(shapeSizes[i]);
+	}
+
+	pool.parallelFor(chunkCount, [&](uint32_t i) {
+		PROFILE_SCOPE("ObjParser::mergeChunk");
+
+		ObjChunk& chunk = chunks[i];
+
+		for (const RelativeIndex& relative : chunk.relativeIndices) {
+			ObjIndex& index = chunk.shapes[relative.shape].indices[relative.corner];
+			switch (relative.attribute) {
+			case OBJ_VERTEX:
+				index.vertex += (int32_t)chunk.positionBase;
+				break;
+			case OBJ_NORMAL:
+				index.normal += (int32_t)chunk.normalBase;
+				break;
+			case OBJ_TEXCOORD:
+				index.texcoord += (int32_t)chunk.texcoordBase;
+				break;
+			}
+		}
+
+		for (size_t k = 0; k < chunk.shapes.size(); k++) {
+			for (const ObjIndex& index : chunk.shapes[k].indices) {
+				if (index.vertex < 0 || (size_t)index.vertex >= positionCount ||
+					index.normal < -1 || (index.normal >= 0 && (size_t)index.normal >= normalCount) ||
+					index.texcoord < -1 || (index.texcoord >= 0 && (size_t)index.texcoord >= texcoordCount)) {
+					chunk.error = "face index out of range in OBJ file!";
+					return;
+				}
+			}
+
+			const std::vector<ObjIndex>& source = chunk.shapes[k].indices;
+			std::copy(source.begin(), source.end(), obj.shapes[chunk.targets[k].first].indices.begin() + chunk.targets[k].second);
+		}
+
+		std::copy(chunk.positions.begin(), chunk.positions.end(), obj.positions.begin() + chunk.positionBase * 3);
+		std::copy(chunk.normals.begin(), chunk.normals.end(), obj.normals.begin() + chunk.normalBase * 3);
+		std::copy(chunk.texcoords.begin(), chunk.texcoords.end(), obj.texcoords.begin() + chunk.texcoordBase * 2);
+	});
+
+	for (const ObjChunk& chunk : chunks) {
+		if (!chunk.error.empty()) {
+			throw std::runtime_error(chunk.error);
+		}
+	}
+
+	// Like tinyobj, groups without faces do not become shapes
+	obj.shapes.erase(std::remove_if(obj.shapes.begin(), obj.shapes.end(), [](const ObjShape& shape) { return shape.indices.empty(); }), obj.shapes.end());
+
+	return obj;
+}
+
+bool ObjParser::writeSynthetic(const std::string& path, uint64_t targetBytes)
+{
+	const uint32_t TILE_SIZE = 128;
+	const uint32_t TILES_PER_ROW = 64;
+	const size_t FLUSH_BYTES = 4 << 20;
+
+	FILE* file = fopen(path.c_str(), "wb");
+	if (file == nullptr) {
+		return false;
+	}
+
+	std::string buffer;
+	buffer.reserve(FLUSH_BYTES + 4096);
+	uint64_t written = 0;
+	uint64_t vertexCount = 0;
+	bool ok = true;
+	char line[256];
+
+	for (uint32_t tile = 0; ok && written + buffer.size() < targetBytes; tile++) {
+		float originX = (float)((tile % TILES_PER_ROW) * (TILE_SIZE - 1));
+		float originZ = (float)((tile / TILES_PER_ROW) * (TILE_SIZE - 1));
+
+		snprintf(line, sizeof(line), "o tile_%u\n", tile);
+		buffer += line;
+
+		for (uint32_t y = 0; y < TILE_SIZE; y++) {
+			for (uint32_t x = 0; x < TILE_SIZE; x++) {
+				float px = originX + x;
+				float pz = originZ + y;
+				float height = 4.0f * std::sin(px * 0.1f) * std::cos(pz * 0.1f);
+				float slopeX = 0.4f * std::cos(px * 0.1f) * std::cos(pz * 0.1f);
+				float slopeZ = -0.4f * std::sin(px * 0.1f) * std::sin(pz * 0.1f);
+				float length = std::sqrt(slopeX * slopeX + 1.0f + slopeZ * slopeZ);
+
+				int n = snprintf(line, sizeof(line), "v %.6f %.6f %.6f\nvt %.6f %.6f\nvn %.6f %.6f %.6f\n",
+					px, height, pz, x / (float)(TILE_SIZE - 1), y / (float)(TILE_SIZE - 1),
+					-slopeX / length, 1.0f / length, -slopeZ / length);
+				buffer.append(line, n);
+			}
+		}
+
+		uint64_t tileBase = vertexCount;
+		vertexCount += TILE_SIZE * TILE_SIZE;
+
+		// Every other tile uses negative indices, counting back from the last vertex written
+		bool relative = tile % 2 == 1;
+
+		for (uint32_t y = 0; y + 1 < TILE_SIZE; y++) {
+			for (uint32_t x = 0; x + 1 < TILE_SIZE; x++) {
+				uint64_t corners[4] = {
+					tileBase + y * TILE_SIZE + x,
+					tileBase + (y + 1) * TILE_SIZE + x,
+					tileBase + (y + 1) * TILE_SIZE + x + 1,
+					tileBase + y * TILE_SIZE + x + 1
+				};
+
+				long long values[4];
+				for (int k = 0; k < 4; k++) {
+					values[k] = relative ? (long long)corners[k] - (long long)vertexCount : (long long)corners[k] + 1;
+				}
+
+				int n = snprintf(line, sizeof(line), "f %lld/%lld/%lld %lld/%lld/%lld %lld/%lld/%lld %lld/%lld/%lld\n",
+					values[0], values[0], values[0], values[1], values[1], values[1],
+					values[2], values[2], values[2], values[3], values[3], values[3]);
+				buffer.append(line, n);
+			}
+
+			if (buffer.size() >= FLUSH_BYTES) {
+				ok = fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+				written += buffer.size();
+				buffer.clear();
+			}
+		}
+	}
+
+	if (ok && !buffer.empty()) {
+		ok = fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+	}
+
+	return fclose(file) == 0 && ok;
+}
@@ -0,0 +1,204 @@
+#include "Profiler.h"
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+struct Event {
+	const char* name;
+	uint64_t start;
+	uint64_t end;
+};
+
+// Written only by its own thread, count is published with release so the main thread
+// can read the events without locking once the capture has stopped
+struct ThreadBuffer {
+	static const uint32_t CAPACITY = 1 << 16;
+
+	std::vector<Event> events;
+	std::atomic<uint32_t> count;
+	std::atomic<uint32_t> dropped;
+	uint32_t threadId;
+	std::string threadName;
+
+	ThreadBuffer(uint32_t threadId) :
+		events(CAPACITY),
+		count(0),
+		dropped(0),
+		threadId(threadId)
+	{
+	}
+};
+
+struct Registry {
+	std::mutex mutex;
+	std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+	std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+	uint32_t framesLeft = 0;
+	std::string path;
+};
+
+Registry& registry()
+{
+	static Registry instance;
+	return instance;
+}
+
+// Registered once per thread, the buffers outlive their threads so a capture can still be written
+ThreadBuffer& localBuffer()
+{
+	static thread_local ThreadBuffer* buffer = nullptr;
+
+	if (buffer == nullptr) {
+		Registry& reg = registry();
+		std::lock_guard<std::mutex> lock(reg.mutex);
+
+		reg.buffers.emplace_back(new ThreadBuffer((uint32_t)reg.buffers.size()));
+		buffer = reg.buffers.back().get();
+	}
+
+	return *buffer;
+}
+
+void writeEscaped(std::ostream& out, const char* text)
+{
+	for (const char* c = text; *c; c++) {
+		if (*c == '"' || *c == '\\') {
+			out << '\\';
+		}
+		out << *c;
+	}
+}
+
+// Trace timestamps are microseconds, keep the nanoseconds as decimals
+void writeMicroseconds(std::ostream& out, uint64_t nanoseconds)
+{
+	uint64_t fraction = nanoseconds % 1000;
+	out << nanoseconds / 1000 << '.' << (char)('0' + fraction / 100) << (char)('0' + fraction / 10 % 10) << (char)('0' + fraction % 10);
+}
+
+}
+
+std::atomic<bool> Profiler::enabled(false);
+
+uint64_t Profiler::now()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - registry().epoch).count();
+}
+
+void Profiler::record(const char* name, uint64_t start, uint64_t end)
+{
+	ThreadBuffer& buffer = localBuffer();
+
+	uint32_t index = buffer.count.load(std::memory_order_relaxed);
+	if (index == ThreadBuffer::CAPACITY) {
+		buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	buffer.events[index] = { name, start, end };
+	buffer.count.store(index + 1, std::memory_order_release);
+}
+
+void Profiler::setThreadName(const char* name)
+{
+	ThreadBuffer& buffer = localBuffer();
+
+	std::lock_guard<std::mutex> lock(registry().mutex);
+	buffer.threadName = name;
+}
+
+void Profiler::beginCapture(uint32_t frameCount, const std::string& path)
+{
+	if (isEnabled() || frameCount == 0) {
+		return;
+	}
+
+	Registry& reg = registry();
+	{
+		std::lock_guard<std::mutex> lock(reg.mutex);
+		for (auto& buffer : reg.buffers) {
+			buffer->count.store(0, std::memory_order_relaxed);
+			buffer->dropped.store(0, std::memory_order_relaxed);
+		}
+		reg.framesLeft = frameCount;
+		reg.path = path;
+	}
+
+	std::cout << "capturing a CPU trace of " << frameCount << " frames" << std::endl;
+	enabled.store(true, std::memory_order_relaxed);
+}
+
+void Profiler::frameMark()
+{
+	if (!isEnabled()) {
+		return;
+	}
+
+	Registry& reg = registry();
+	if (--reg.framesLeft == 0) {
+		endCapture();
+	}
+}
+
+void Profiler::endCapture()
+{
+	enabled.store(false, std::memory_order_relaxed);
+
+	Registry& reg = registry();
+	std::lock_guard<std::mutex> lock(reg.mutex);
+
+	std::ofstream out(reg.path, std::ios::trunc);
+	if (!out.is_open()) {
+		std::cerr << "failed to write trace " << reg.path << std::endl;
+		return;
+	}
+
+	size_t eventCount = 0;
+	uint32_t dropped = 0;
+	bool first = true;
+
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+	for (auto& buffer : reg.buffers) {
+		uint32_t count = buffer->count.load(std::memory_order_acquire);
+		dropped += buffer->dropped.load(std::memory_order_relaxed);
+
+		if (count == 0) {
+			continue;
+		}
+
+		std::string threadName = buffer->threadName.empty() ? "thread " + std::to_string(buffer->threadId) : buffer->threadName;
+
+		out << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << buffer->threadId << ",\"args\":{\"name\":\"";
+		writeEscaped(out, threadName.c_str());
+		out << "\"}}";
+		first = false;
+
+		for (uint32_t i = 0; i < count; i++) {
+			const Event& event = buffer->events[i];
+
+			out << ",\n{\"name\":\"";
+			writeEscaped(out, event.name);
+			out << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << buffer->threadId << ",\"ts\":";
+			writeMicroseconds(out, event.start);
+			out << ",\"dur\":";
+			writeMicroseconds(out, event.end - event.start);
+			out << "}";
+		}
+
+		eventCount += count;
+	}
+
+	out << "\n]}\n";
+
+	std::cout << "wrote " << eventCount << " trace events to " << reg.path;
+	if (dropped > 0) {
+		std::cout << " (" << dropped << " dropped, buffers full)";
+	}
+	std::cout << std::endl;
+}
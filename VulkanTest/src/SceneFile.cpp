@@ -0,0 +1,155 @@
+#include "SceneFile.h"
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <glm/gtc/matrix_transform.hpp>
+
+static bool readFloats(std::istringstream& tokens, float* values, int count)
+{
+	for (int i = 0; i < count; i++) {
+		if (!(tokens >> values[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+SceneDescription SceneFile::load(const std::string& path)
+{
+	std::ifstream file(path);
+	if (!file.is_open()) {
+		throw std::runtime_error("failed to open scene " + path + "!");
+	}
+
+	std::stringstream text;
+	text << file.rdbuf();
+
+	return parse(text.str(), path);
+}
+
+SceneDescription SceneFile::parse(const std::string& text, const std::string& path)
+{
+	SceneDescription scene;
+	std::map<std::string, uint32_t> meshNames;
+	std::map<std::string, uint32_t> textureNames;
+	// Asset indices by path, each file is loaded and cached once however many names declare it
+	std::map<std::string, uint32_t> meshPaths;
+	std::map<std::string, uint32_t> texturePaths;
+
+	std::istringstream lines(text);
+	std::string line;
+	uint32_t lineNumber = 0;
+
+	while (std::getline(lines, line)) {
+		lineNumber++;
+
+		auto fail = [&](const std::string& message) {
+			throw std::runtime_error(path + ":" + std::to_string(lineNumber) + ": " + message);
+		};
+
+		size_t comment = line.find('#');
+		if (comment != std::string::npos) {
+			line.erase(comment);
+		}
+
+		std::istringstream tokens(line);
+		std::string keyword;
+		if (!(tokens >> keyword)) {
+			continue;
+		}
+
+		if (keyword == "mesh" || keyword == "texture") {
+			std::string name;
+			std::string assetPath;
+			if (!(tokens >> name >> assetPath)) {
+				fail(keyword + " needs a name and a path");
+			}
+
+			bool isMesh = keyword == "mesh";
+			std::map<std::string, uint32_t>& names = isMesh ? meshNames : textureNames;
+			std::map<std::string, uint32_t>& assets = isMesh ? meshPaths : texturePaths;
+			std::vector<std::string>& paths = isMesh ? scene.meshes : scene.textures;
+
+			if (names.count(name) != 0) {
+				fail(keyword + " " + name + " is declared twice");
+			}
+
+			auto asset = assets.find(assetPath);
+			if (asset == assets.end()) {
+				asset = assets.emplace(assetPath, (uint32_t)paths.size()).first;
+				paths.push_back(assetPath);
+			}
+			names[name] = asset->second;
+		}
+		else if (keyword == "object") {
+			std::string meshName;
+			std::string textureName;
+			if (!(tokens >> meshName >> textureName)) {
+				fail("object needs a mesh and a texture name");
+			}
+
+			auto mesh = meshNames.find(meshName);
+			if (mesh == meshNames.end()) {
+				fail("unknown mesh " + meshName);
+			}
+			auto texture = textureNames.find(textureName);
+			if (texture == textureNames.end()) {
+				fail("unknown texture " + textureName);
+			}
+
+			glm::vec3 position(0.0f);
+			glm::vec3 rotation(0.0f);
+			float scale = 1.0f;
+
+			// A uniform scale keeps the normals transformed by the model matrix unit length and perpendicular
+			std::string property;
+			while (tokens >> property) {
+				if (property == "position") {
+					if (!readFloats(tokens, &position.x, 3)) {
+						fail("position needs three numbers");
+					}
+				}
+				else if (property == "rotation") {
+					if (!readFloats(tokens, &rotation.x, 3)) {
+						fail("rotation needs three numbers");
+					}
+				}
+				else if (property == "scale") {
+					if (!readFloats(tokens, &scale, 1) || scale <= 0.0f) {
+						fail("scale needs one positive number");
+					}
+				}
+				else {
+					fail("unknown object property " + property);
+				}
+			}
+
+			glm::mat4 transform = glm::translate(glm::mat4(), position);
+			transform = glm::rotate(transform, glm::radians(rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
+			transform = glm::rotate(transform, glm::radians(rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
+			transform = glm::rotate(transform, glm::radians(rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
+			transform = glm::scale(transform, glm::vec3(scale));
+
+			scene.objects.push_back({ mesh->second, texture->second, transform });
+		}
+		else {
+			fail("unknown statement " + keyword);
+		}
+	}
+
+	if (scene.objects.empty()) {
+		throw std::runtime_error(path + ": the scene has no objects!");
+	}
+
+	return scene;
+}
+
+SceneDescription SceneFile::single(const std::string& meshPath, const std::string& texturePath)
+{
+	SceneDescription scene;
+	scene.meshes.push_back(meshPath);
+	scene.textures.push_back(texturePath);
+	scene.objects.push_back({ 0, 0, glm::mat4() });
+	return scene;
+}
@@ -0,0 +1,205 @@
+#include "TextureCache.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+static const uint8_t KTX_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+static const uint32_t KTX_ENDIANNESS = 0x04030201;
+static const char SOURCE_KEY[] = "VulkanTest.source";
+
+static const uint32_t GL_RGB = 0x1907;
+static const uint32_t GL_RGBA = 0x1908;
+static const uint32_t GL_COMPRESSED_RGB_S3TC_DXT1_EXT = 0x83F0;
+static const uint32_t GL_COMPRESSED_RGBA_S3TC_DXT5_EXT = 0x83F3;
+static const uint32_t GL_COMPRESSED_RGBA_BPTC_UNORM = 0x8E8C;
+
+struct KtxHeader {
+	uint8_t identifier[12];
+	uint32_t endianness;
+	uint32_t glType;
+	uint32_t glTypeSize;
+	uint32_t glFormat;
+	uint32_t glInternalFormat;
+	uint32_t glBaseInternalFormat;
+	uint32_t pixelWidth;
+	uint32_t pixelHeight;
+	uint32_t pixelDepth;
+	uint32_t numberOfArrayElements;
+	uint32_t numberOfFaces;
+	uint32_t numberOfMipmapLevels;
+	uint32_t bytesOfKeyValueData;
+};
+
+// Value of the source key, which tells whether the cache is still current.
+struct KtxSourceValue {
+	uint64_t sourceHash;
+	uint64_t sourceSize;
+	uint32_t importFlags;
+};
+
+static_assert(sizeof(KtxHeader) == 64, "KTX header layout");
+
+static uint32_t glInternalFormat(BlockFormat format)
+{
+	switch (format) {
+	case BlockFormat::BC1:
+		return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	case BlockFormat::BC3:
+		return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	case BlockFormat::BC7:
+		return GL_COMPRESSED_RGBA_BPTC_UNORM;
+	}
+	return 0;
+}
+
+// BC1 is stored without alpha, the other formats carry it
+static uint32_t glBaseInternalFormat(BlockFormat format)
+{
+	return format == BlockFormat::BC1 ? GL_RGB : GL_RGBA;
+}
+
+static uint32_t keyValueBytes()
+{
+	uint32_t keyAndValueByteSize = sizeof(SOURCE_KEY) + sizeof(KtxSourceValue);
+	return (sizeof(uint32_t) + keyAndValueByteSize + 3) & ~3u;
+}
+
+bool TextureCache::open(const std::string& path, uint64_t sourceHash, uint64_t sourceSize, uint32_t importFlags)
+{
+	close();
+
+	if (!file.open(path) || file.size() < sizeof(KtxHeader) + keyValueBytes()) {
+		close();
+		return false;
+	}
+
+	KtxHeader header;
+	memcpy(&header, file.data(), sizeof(header));
+
+	BlockFormat format;
+	if (header.glInternalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT) {
+		format = BlockFormat::BC1;
+	}
+	else if (header.glInternalFormat == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT) {
+		format = BlockFormat::BC3;
+	}
+	else if (header.glInternalFormat == GL_COMPRESSED_RGBA_BPTC_UNORM) {
+		format = BlockFormat::BC7;
+	}
+	else {
+		close();
+		return false;
+	}
+
+	// Only caches this class wrote are accepted, so the key/value data must be exactly the source key
+	const char* keyValue = file.data() + sizeof(KtxHeader);
+	uint32_t keyAndValueByteSize;
+	memcpy(&keyAndValueByteSize, keyValue, sizeof(uint32_t));
+
+	KtxSourceValue source;
+	memcpy(&source, keyValue + sizeof(uint32_t) + sizeof(SOURCE_KEY), sizeof(source));
+
+	if (memcmp(header.identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER)) != 0 || header.endianness != KTX_ENDIANNESS ||
+		header.pixelDepth != 0 || header.numberOfArrayElements != 0 || header.numberOfFaces != 1 ||
+		header.numberOfMipmapLevels == 0 || header.numberOfMipmapLevels > 32 || header.bytesOfKeyValueData != keyValueBytes() ||
+		keyAndValueByteSize != sizeof(SOURCE_KEY) + sizeof(KtxSourceValue) || memcmp(keyValue + sizeof(uint32_t), SOURCE_KEY, sizeof(SOURCE_KEY)) != 0 ||
+		source.sourceHash != sourceHash || source.sourceSize != sourceSize || source.importFlags != importFlags) {
+		close();
+		return false;
+	}
+
+	// Each level is its byte count followed by the blocks, which layout() gives the expected size of
+	std::vector<MipLevel> levels = TextureCompressor::layout(header.pixelWidth, header.pixelHeight, header.numberOfMipmapLevels, format);
+	size_t offset = sizeof(KtxHeader) + header.bytesOfKeyValueData;
+
+	for (MipLevel& level : levels) {
+		uint32_t imageSize;
+		if (offset + sizeof(uint32_t) > file.size()) {
+			close();
+			return false;
+		}
+		memcpy(&imageSize, file.data() + offset, sizeof(uint32_t));
+
+		if (imageSize != level.size || offset + sizeof(uint32_t) + imageSize > file.size()) {
+			close();
+			return false;
+		}
+
+		level.offset = offset + sizeof(uint32_t);
+		offset = (level.offset + imageSize + 3) & ~(size_t)3;
+	}
+
+	compressedTexture.format = format;
+	compressedTexture.width = header.pixelWidth;
+	compressedTexture.height = header.pixelHeight;
+	compressedTexture.levels = levels;
+	compressedTexture.data = reinterpret_cast<const uint8_t*>(file.data());
+
+	return true;
+}
+
+void TextureCache::close()
+{
+	file.close();
+	compressedTexture = CompressedTexture();
+}
+
+bool TextureCache::write(const std::string& path, uint64_t sourceHash, uint64_t sourceSize, uint32_t importFlags, const CompressedTexture& texture)
+{
+	KtxHeader header = {};
+	memcpy(header.identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER));
+	header.endianness = KTX_ENDIANNESS;
+	// Compressed data has no GL type or format, and KTX counts it in bytes
+	header.glTypeSize = 1;
+	header.glInternalFormat = glInternalFormat(texture.format);
+	header.glBaseInternalFormat = glBaseInternalFormat(texture.format);
+	header.pixelWidth = texture.width;
+	header.pixelHeight = texture.height;
+	header.numberOfFaces = 1;
+	header.numberOfMipmapLevels = (uint32_t)texture.levels.size();
+	header.bytesOfKeyValueData = keyValueBytes();
+
+	uint32_t keyAndValueByteSize = sizeof(SOURCE_KEY) + sizeof(KtxSourceValue);
+	KtxSourceValue source;
+	memset(&source, 0, sizeof(source));
+	source.sourceHash = sourceHash;
+	source.sourceSize = sourceSize;
+	source.importFlags = importFlags;
+	static const char padding[4] = {};
+
+	// Written under a temporary name so a crash never leaves a truncated cache behind
+	std::string tempPath = path + ".tmp";
+	{
+		std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+		if (!out.is_open()) {
+			return false;
+		}
+
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		out.write(reinterpret_cast<const char*>(&keyAndValueByteSize), sizeof(keyAndValueByteSize));
+		out.write(SOURCE_KEY, sizeof(SOURCE_KEY));
+		out.write(reinterpret_cast<const char*>(&source), sizeof(source));
+		out.write(padding, header.bytesOfKeyValueData - sizeof(uint32_t) - keyAndValueByteSize);
+
+		for (const MipLevel& level : texture.levels) {
+			uint32_t imageSize = (uint32_t)level.size;
+			out.write(reinterpret_cast<const char*>(&imageSize), sizeof(imageSize));
+			out.write(reinterpret_cast<const char*>(texture.data + level.offset), level.size);
+			out.write(padding, (4 - level.size % 4) % 4);
+		}
+
+		if (!out.good()) {
+			out.close();
+			std::remove(tempPath.c_str());
+			return false;
+		}
+	}
+
+	std::remove(path.c_str());
+	if (std::rename(tempPath.c_str(), path.c_str()) != 0) {
+		std::remove(tempPath.c_str());
+		return false;
+	}
+
+	return true;
+}
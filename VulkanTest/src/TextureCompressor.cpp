@@ -0,0 +1,721 @@
+#include "TextureCompressor.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define TEXTURE_COMPRESSOR_SSE2
+#endif
+
+static const uint32_t BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// Pixels of one block split by channel, so four of them fit a vector register.
+struct BlockPixels {
+	float channels[4][16];
+};
+
+static void loadBlock(const uint8_t* pixels, BlockPixels& block)
+{
+	for (int i = 0; i < 16; i++) {
+		for (int c = 0; c < 4; c++) {
+			block.channels[c][i] = pixels[i * 4 + c];
+		}
+	}
+}
+
+// Picks the closest palette entry for every pixel and returns the summed squared error.
+// Palette entries hold 4 floats, of which the first channelCount are compared.
+static float selectIndices(const float (*channels)[16], int channelCount, const float (*palette)[4], int paletteCount, uint8_t indices[16])
+{
+#ifdef TEXTURE_COMPRESSOR_SSE2
+	__m128 total = _mm_setzero_ps();
+
+	for (int group = 0; group < 16; group += 4) {
+		__m128 values[4];
+		for (int c = 0; c < channelCount; c++) {
+			values[c] = _mm_loadu_ps(&channels[c][group]);
+		}
+
+		__m128 best = _mm_set1_ps(FLT_MAX);
+		__m128i bestIndex = _mm_setzero_si128();
+
+		for (int p = 0; p < paletteCount; p++) {
+			__m128 distance = _mm_setzero_ps();
+			for (int c = 0; c < channelCount; c++) {
+				__m128 difference = _mm_sub_ps(values[c], _mm_set1_ps(palette[p][c]));
+				distance = _mm_add_ps(distance, _mm_mul_ps(difference, difference));
+			}
+
+			__m128i closer = _mm_castps_si128(_mm_cmplt_ps(distance, best));
+			best = _mm_min_ps(distance, best);
+			bestIndex = _mm_or_si128(_mm_andnot_si128(closer, bestIndex), _mm_and_si128(closer, _mm_set1_epi32(p)));
+		}
+
+		int32_t lanes[4];
+		_mm_storeu_si128((__m128i*)lanes, bestIndex);
+		for (int i = 0; i < 4; i++) {
+			indices[group + i] = (uint8_t)lanes[i];
+		}
+
+		total = _mm_add_ps(total, best);
+	}
+
+	float sums[4];
+	_mm_storeu_ps(sums, total);
+	return sums[0] + sums[1] + sums[2] + sums[3];
+#else
+	float total = 0.0f;
+
+	for (int i = 0; i < 16; i++) {
+		float best = FLT_MAX;
+		int bestIndex = 0;
+
+		for (int p = 0; p < paletteCount; p++) {
+			float distance = 0.0f;
+			for (int c = 0; c < channelCount; c++) {
+				float difference = channels[c][i] - palette[p][c];
+				distance += difference * difference;
+			}
+
+			if (distance < best) {
+				best = distance;
+				bestIndex = p;
+			}
+		}
+
+		indices[i] = (uint8_t)bestIndex;
+		total += best;
+	}
+
+	return total;
+#endif
+}
+
+// Endpoints at the extremes of the block's projection onto its principal axis.
+static void fitEndpoints(const BlockPixels& block, int channelCount, float e0[4], float e1[4])
+{
+	float mean[4] = {};
+	for (int c = 0; c < channelCount; c++) {
+		for (int i = 0; i < 16; i++) {
+			mean[c] += block.channels[c][i];
+		}
+		mean[c] /= 16.0f;
+	}
+
+	float covariance[4][4] = {};
+	for (int i = 0; i < 16; i++) {
+		for (int a = 0; a < channelCount; a++) {
+			for (int b = a; b < channelCount; b++) {
+				covariance[a][b] += (block.channels[a][i] - mean[a]) * (block.channels[b][i] - mean[b]);
+			}
+		}
+	}
+	for (int a = 0; a < channelCount; a++) {
+		for (int b = 0; b < a; b++) {
+			covariance[a][b] = covariance[b][a];
+		}
+	}
+
+	// Power iteration, started from the diagonal of the bounding box
+	float axis[4] = {};
+	for (int c = 0; c < channelCount; c++) {
+		float low = *std::min_element(block.channels[c], block.channels[c] + 16);
+		float high = *std::max_element(block.channels[c], block.channels[c] + 16);
+		axis[c] = high - low;
+	}
+
+	for (int iteration = 0; iteration < 8; iteration++) {
+		float next[4] = {};
+		float length = 0.0f;
+		for (int a = 0; a < channelCount; a++) {
+			for (int b = 0; b < channelCount; b++) {
+				next[a] += covariance[a][b] * axis[b];
+			}
+			length = std::max(length, std::abs(next[a]));
+		}
+
+		if (length < 1e-6f) {
+			break;
+		}
+
+		for (int c = 0; c < channelCount; c++) {
+			axis[c] = next[c] / length;
+		}
+	}
+
+	float lengthSquared = 0.0f;
+	for (int c = 0; c < channelCount; c++) {
+		lengthSquared += axis[c] * axis[c];
+	}
+
+	if (lengthSquared < 1e-12f) {
+		for (int c = 0; c < 4; c++) {
+			e0[c] = e1[c] = mean[c];
+		}
+		return;
+	}
+
+	float low = FLT_MAX;
+	float high = -FLT_MAX;
+	for (int i = 0; i < 16; i++) {
+		float t = 0.0f;
+		for (int c = 0; c < channelCount; c++) {
+			t += (block.channels[c][i] - mean[c]) * axis[c];
+		}
+		low = std::min(low, t);
+		high = std::max(high, t);
+	}
+
+	for (int c = 0; c < 4; c++) {
+		e0[c] = std::min(std::max(mean[c] + axis[c] * low / lengthSquared, 0.0f), 255.0f);
+		e1[c] = std::min(std::max(mean[c] + axis[c] * high / lengthSquared, 0.0f), 255.0f);
+	}
+}
+
+// Least squares endpoints for fixed indices, weights[i] being how much of e1 palette entry i holds.
+static bool refineEndpoints(const BlockPixels& block, int channelCount, const uint8_t indices[16], const float* weights, float e0[4], float e1[4])
+{
+	float alphaSquared = 0.0f;
+	float betaSquared = 0.0f;
+	float alphaBeta = 0.0f;
+	float alphaX[4] = {};
+	float betaX[4] = {};
+
+	for (int i = 0; i < 16; i++) {
+		float beta = weights[indices[i]];
+		float alpha = 1.0f - beta;
+
+		alphaSquared += alpha * alpha;
+		betaSquared += beta * beta;
+		alphaBeta += alpha * beta;
+		for (int c = 0; c < channelCount; c++) {
+			alphaX[c] += alpha * block.channels[c][i];
+			betaX[c] += beta * block.channels[c][i];
+		}
+	}
+
+	float determinant = alphaSquared * betaSquared - alphaBeta * alphaBeta;
+	if (std::abs(determinant) < 1e-6f) {
+		return false;
+	}
+
+	for (int c = 0; c < channelCount; c++) {
+		e0[c] = std::min(std::max((alphaX[c] * betaSquared - betaX[c] * alphaBeta) / determinant, 0.0f), 255.0f);
+		e1[c] = std::min(std::max((betaX[c] * alphaSquared - alphaX[c] * alphaBeta) / determinant, 0.0f), 255.0f);
+	}
+	return true;
+}
+
+static uint16_t packColor565(const float color[4])
+{
+	uint32_t r = (uint32_t)(color[0] * 31.0f / 255.0f + 0.5f);
+	uint32_t g = (uint32_t)(color[1] * 63.0f / 255.0f + 0.5f);
+	uint32_t b = (uint32_t)(color[2] * 31.0f / 255.0f + 0.5f);
+	return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static void unpackColor565(uint16_t packed, uint32_t color[3])
+{
+	uint32_t r = (packed >> 11) & 31;
+	uint32_t g = (packed >> 5) & 63;
+	uint32_t b = packed & 31;
+	color[0] = (r << 3) | (r >> 2);
+	color[1] = (g << 2) | (g >> 4);
+	color[2] = (b << 3) | (b >> 2);
+}
+
+static void colorPalette(uint16_t packed0, uint16_t packed1, bool fourColors, uint32_t palette[4][4])
+{
+	unpackColor565(packed0, palette[0]);
+	unpackColor565(packed1, palette[1]);
+
+	for (int c = 0; c < 3; c++) {
+		if (fourColors) {
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+		else {
+			palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+			palette[3][c] = 0;
+		}
+	}
+
+	palette[0][3] = palette[1][3] = palette[2][3] = 255;
+	palette[3][3] = fourColors ? 255 : 0;
+}
+
+// BC1 color block in four color mode, which BC3 always decodes it as.
+static void encodeColorBlock(const BlockPixels& block, uint8_t* out)
+{
+	static const float WEIGHTS[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+
+	float e0[4];
+	float e1[4];
+	fitEndpoints(block, 3, e0, e1);
+
+	float bestError = FLT_MAX;
+	uint16_t best0 = 0;
+	uint16_t best1 = 0;
+	uint8_t bestIndices[16] = {};
+
+	for (int iteration = 0; iteration < 2; iteration++) {
+		uint16_t packed0 = packColor565(e0);
+		uint16_t packed1 = packColor565(e1);
+		if (packed0 < packed1) {
+			std::swap(packed0, packed1);
+		}
+
+		uint32_t palette[4][4];
+		colorPalette(packed0, packed1, true, palette);
+
+		float paletteValues[4][4];
+		for (int p = 0; p < 4; p++) {
+			for (int c = 0; c < 4; c++) {
+				paletteValues[p][c] = (float)palette[p][c];
+			}
+		}
+
+		// Equal endpoints only have three color mode, where every pixel must use index 0
+		uint8_t indices[16];
+		float error = selectIndices(block.channels, 3, paletteValues, packed0 == packed1 ? 1 : 4, indices);
+
+		if (error < bestError) {
+			bestError = error;
+			best0 = packed0;
+			best1 = packed1;
+			memcpy(bestIndices, indices, sizeof(indices));
+		}
+
+		if (packed0 == packed1 || !refineEndpoints(block, 3, indices, WEIGHTS, e0, e1)) {
+			break;
+		}
+	}
+
+	uint32_t packedIndices = 0;
+	for (int i = 0; i < 16; i++) {
+		packedIndices |= (uint32_t)bestIndices[i] << (i * 2);
+	}
+
+	out[0] = (uint8_t)(best0 & 0xff);
+	out[1] = (uint8_t)(best0 >> 8);
+	out[2] = (uint8_t)(best1 & 0xff);
+	out[3] = (uint8_t)(best1 >> 8);
+	memcpy(out + 4, &packedIndices, 4);
+}
+
+static void alphaPalette(uint32_t alpha0, uint32_t alpha1, uint32_t palette[8])
+{
+	palette[0] = alpha0;
+	palette[1] = alpha1;
+
+	if (alpha0 > alpha1) {
+		for (uint32_t i = 0; i < 6; i++) {
+			palette[i + 2] = ((6 - i) * alpha0 + (1 + i) * alpha1) / 7;
+		}
+	}
+	else {
+		for (uint32_t i = 0; i < 4; i++) {
+			palette[i + 2] = ((4 - i) * alpha0 + (1 + i) * alpha1) / 5;
+		}
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+}
+
+static void encodeAlphaBlock(const BlockPixels& block, uint8_t* out)
+{
+	const float* alpha = block.channels[3];
+	uint32_t alpha0 = (uint32_t)*std::max_element(alpha, alpha + 16);
+	uint32_t alpha1 = (uint32_t)*std::min_element(alpha, alpha + 16);
+
+	out[0] = (uint8_t)alpha0;
+	out[1] = (uint8_t)alpha1;
+	memset(out + 2, 0, 6);
+
+	if (alpha0 == alpha1) {
+		return;
+	}
+
+	uint32_t palette[8];
+	alphaPalette(alpha0, alpha1, palette);
+
+	float paletteValues[8][4] = {};
+	for (int p = 0; p < 8; p++) {
+		paletteValues[p][0] = (float)palette[p];
+	}
+
+	uint8_t indices[16];
+	selectIndices(&block.channels[3], 1, paletteValues, 8, indices);
+
+	uint64_t packedIndices = 0;
+	for (int i = 0; i < 16; i++) {
+		packedIndices |= (uint64_t)indices[i] << (i * 3);
+	}
+	for (int i = 0; i < 6; i++) {
+		out[2 + i] = (uint8_t)(packedIndices >> (i * 8));
+	}
+}
+
+// Mode 6 endpoints are 7 bits per channel plus a shared lowest bit per endpoint.
+static void quantizeBC7Endpoint(const float endpoint[4], uint32_t quantized[4], uint32_t& pBit)
+{
+	float bestError = FLT_MAX;
+
+	for (uint32_t p = 0; p < 2; p++) {
+		uint32_t candidate[4];
+		float error = 0.0f;
+
+		for (int c = 0; c < 4; c++) {
+			int value = (int)std::floor((endpoint[c] - p) * 0.5f + 0.5f);
+			candidate[c] = (uint32_t)std::min(std::max(value, 0), 127);
+
+			float difference = (float)(candidate[c] * 2 + p) - endpoint[c];
+			error += difference * difference;
+		}
+
+		if (error < bestError) {
+			bestError = error;
+			pBit = p;
+			memcpy(quantized, candidate, sizeof(candidate));
+		}
+	}
+}
+
+static void bc7Palette(const uint32_t endpoint0[4], const uint32_t endpoint1[4], uint32_t palette[16][4])
+{
+	for (int i = 0; i < 16; i++) {
+		for (int c = 0; c < 4; c++) {
+			palette[i][c] = ((64 - BC7_WEIGHTS[i]) * endpoint0[c] + BC7_WEIGHTS[i] * endpoint1[c] + 32) >> 6;
+		}
+	}
+}
+
+class BitWriter
+{
+public:
+	explicit BitWriter(uint8_t* out) : out(out), position(0)
+	{
+		memset(out, 0, 16);
+	}
+
+	void write(uint32_t value, uint32_t bits)
+	{
+		for (uint32_t i = 0; i < bits; i++, position++) {
+			out[position >> 3] |= (uint8_t)(((value >> i) & 1) << (position & 7));
+		}
+	}
+
+private:
+	uint8_t* out;
+	uint32_t position;
+};
+
+class BitReader
+{
+public:
+	explicit BitReader(const uint8_t* in) : in(in), position(0) {}
+
+	uint32_t read(uint32_t bits)
+	{
+		uint32_t value = 0;
+		for (uint32_t i = 0; i < bits; i++, position++) {
+			value |= (uint32_t)((in[position >> 3] >> (position & 7)) & 1) << i;
+		}
+		return value;
+	}
+
+private:
+	const uint8_t* in;
+	uint32_t position;
+};
+
+static void encodeBC7Block(const BlockPixels& block, uint8_t* out)
+{
+	float weights[16];
+	for (int i = 0; i < 16; i++) {
+		weights[i] = BC7_WEIGHTS[i] / 64.0f;
+	}
+
+	float e0[4];
+	float e1[4];
+	fitEndpoints(block, 4, e0, e1);
+
+	float bestError = FLT_MAX;
+	uint32_t best[2][4] = {};
+	uint32_t bestP[2] = {};
+	uint8_t bestIndices[16] = {};
+
+	for (int iteration = 0; iteration < 3; iteration++) {
+		uint32_t quantized[2][4];
+		uint32_t pBits[2];
+		quantizeBC7Endpoint(e0, quantized[0], pBits[0]);
+		quantizeBC7Endpoint(e1, quantized[1], pBits[1]);
+
+		uint32_t endpoints[2][4];
+		for (int c = 0; c < 4; c++) {
+			endpoints[0][c] = quantized[0][c] * 2 + pBits[0];
+			endpoints[1][c] = quantized[1][c] * 2 + pBits[1];
+		}
+
+		uint32_t palette[16][4];
+		bc7Palette(endpoints[0], endpoints[1], palette);
+
+		float paletteValues[16][4];
+		for (int p = 0; p < 16; p++) {
+			for (int c = 0; c < 4; c++) {
+				paletteValues[p][c] = (float)palette[p][c];
+			}
+		}
+
+		uint8_t indices[16];
+		float error = selectIndices(block.channels, 4, paletteValues, 16, indices);
+
+		if (error < bestError) {
+			bestError = error;
+			memcpy(best, quantized, sizeof(best));
+			memcpy(bestP, pBits, sizeof(bestP));
+			memcpy(bestIndices, indices, sizeof(indices));
+		}
+
+		if (!refineEndpoints(block, 4, indices, weights, e0, e1)) {
+			break;
+		}
+	}
+
+	// The first pixel's index is stored without its top bit, so it has to be below 8
+	if (bestIndices[0] & 8) {
+		std::swap(best[0], best[1]);
+		std::swap(bestP[0], bestP[1]);
+		for (int i = 0; i < 16; i++) {
+			bestIndices[i] = 15 - bestIndices[i];
+		}
+	}
+
+	BitWriter writer(out);
+	writer.write(1 << 6, 7);
+	for (int c = 0; c < 4; c++) {
+		writer.write(best[0][c], 7);
+		writer.write(best[1][c], 7);
+	}
+	writer.write(bestP[0], 1);
+	writer.write(bestP[1], 1);
+	writer.write(bestIndices[0], 3);
+	for (int i = 1; i < 16; i++) {
+		writer.write(bestIndices[i], 4);
+	}
+}
+
+uint32_t TextureCompressor::blockBytes(BlockFormat format)
+{
+	return format == BlockFormat::BC1 ? 8 : 16;
+}
+
+const char* TextureCompressor::formatName(BlockFormat format)
+{
+	switch (format) {
+	case BlockFormat::BC1:
+		return "BC1";
+	case BlockFormat::BC3:
+		return "BC3";
+	case BlockFormat::BC7:
+		return "BC7";
+	}
+	return "unknown";
+}
+
+std::vector<MipLevel> TextureCompressor::layout(uint32_t width, uint32_t height, uint32_t levels, BlockFormat format)
+{
+	std::vector<MipLevel> chain(levels);
+
+	size_t offset = 0;
+	for (uint32_t i = 0; i < levels; i++) {
+		chain[i].width = width;
+		chain[i].height = height;
+		chain[i].offset = offset;
+		chain[i].size = (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+
+		// Buffer to image copies need offsets aligned to the block size
+		offset += (chain[i].size + 15) & ~(size_t)15;
+
+		width = std::max(width / 2, 1u);
+		height = std::max(height / 2, 1u);
+	}
+
+	return chain;
+}
+
+void TextureCompressor::compress(const uint8_t* rgba, uint32_t width, uint32_t height, BlockFormat format, uint8_t* blocks, ThreadPool& pool)
+{
+	uint32_t blocksX = (width + 3) / 4;
+	uint32_t blocksY = (height + 3) / 4;
+	uint32_t bytes = blockBytes(format);
+
+	pool.parallelFor(blocksY, [&](uint32_t blockY) {
+		PROFILE_SCOPE("TextureCompressor::compress");
+
+		uint8_t pixels[64];
+
+		for (uint32_t blockX = 0; blockX < blocksX; blockX++) {
+			// Blocks past the edge of small or odd sized levels repeat the last row and column
+			for (uint32_t y = 0; y < 4; y++) {
+				uint32_t sourceY = std::min(blockY * 4 + y, height - 1);
+				for (uint32_t x = 0; x < 4; x++) {
+					uint32_t sourceX = std::min(blockX * 4 + x, width - 1);
+					memcpy(pixels + (y * 4 + x) * 4, rgba + ((size_t)sourceY * width + sourceX) * 4, 4);
+				}
+			}
+
+			encodeBlock(format, pixels, blocks + ((size_t)blockY * blocksX + blockX) * bytes);
+		}
+	});
+}
+
+void TextureCompressor::decompress(const uint8_t* blocks, uint32_t width, uint32_t height, BlockFormat format, uint8_t* rgba)
+{
+	uint32_t blocksX = (width + 3) / 4;
+	uint32_t blocksY = (height + 3) / 4;
+	uint32_t bytes = blockBytes(format);
+
+	uint8_t pixels[64];
+
+	for (uint32_t blockY = 0; blockY < blocksY; blockY++) {
+		for (uint32_t blockX = 0; blockX < blocksX; blockX++) {
+			decodeBlock(format, blocks + ((size_t)blockY * blocksX + blockX) * bytes, pixels);
+
+			for (uint32_t y = 0; y < 4 && blockY * 4 + y < height; y++) {
+				for (uint32_t x = 0; x < 4 && blockX * 4 + x < width; x++) {
+					memcpy(rgba + ((size_t)(blockY * 4 + y) * width + blockX * 4 + x) * 4, pixels + (y * 4 + x) * 4, 4);
+				}
+			}
+		}
+	}
+}
+
+double TextureCompressor::psnr(const uint8_t* rgba, uint32_t width, uint32_t height, BlockFormat format, const uint8_t* blocks)
+{
+	size_t pixelCount = (size_t)width * height;
+	std::vector<uint8_t> decoded(pixelCount * 4);
+	decompress(blocks, width, height, format, decoded.data());
+
+	uint32_t channelCount = format == BlockFormat::BC1 ? 3 : 4;
+	double squaredError = 0.0;
+	for (size_t i = 0; i < pixelCount; i++) {
+		for (uint32_t c = 0; c < channelCount; c++) {
+			double difference = (double)decoded[i * 4 + c] - rgba[i * 4 + c];
+			squaredError += difference * difference;
+		}
+	}
+
+	double meanSquaredError = squaredError / (pixelCount * channelCount);
+	return meanSquaredError > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / meanSquaredError) : 99.0;
+}
+
+bool TextureCompressor::hasAlpha(const uint8_t* rgba, size_t pixelCount)
+{
+	for (size_t i = 0; i < pixelCount; i++) {
+		if (rgba[i * 4 + 3] != 255) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void TextureCompressor::encodeBlock(BlockFormat format, const uint8_t* pixels, uint8_t* block)
+{
+	BlockPixels blockPixels;
+	loadBlock(pixels, blockPixels);
+
+	switch (format) {
+	case BlockFormat::BC1:
+		encodeColorBlock(blockPixels, block);
+		break;
+	case BlockFormat::BC3:
+		encodeAlphaBlock(blockPixels, block);
+		encodeColorBlock(blockPixels, block + 8);
+		break;
+	case BlockFormat::BC7:
+		encodeBC7Block(blockPixels, block);
+		break;
+	}
+}
+
+void TextureCompressor::decodeBlock(BlockFormat format, const uint8_t* block, uint8_t* pixels)
+{
+	if (format == BlockFormat::BC7) {
+		BitReader reader(block);
+
+		// Only mode 6 is written, other modes decode as transparent black
+		if (reader.read(7) != 1 << 6) {
+			memset(pixels, 0, 64);
+			return;
+		}
+
+		uint32_t endpoints[2][4];
+		for (int c = 0; c < 4; c++) {
+			endpoints[0][c] = reader.read(7) << 1;
+			endpoints[1][c] = reader.read(7) << 1;
+		}
+
+		uint32_t p0 = reader.read(1);
+		uint32_t p1 = reader.read(1);
+		for (int c = 0; c < 4; c++) {
+			endpoints[0][c] |= p0;
+			endpoints[1][c] |= p1;
+		}
+
+		uint32_t palette[16][4];
+		bc7Palette(endpoints[0], endpoints[1], palette);
+
+		for (int i = 0; i < 16; i++) {
+			uint32_t index = reader.read(i == 0 ? 3 : 4);
+			for (int c = 0; c < 4; c++) {
+				pixels[i * 4 + c] = (uint8_t)palette[index][c];
+			}
+		}
+		return;
+	}
+
+	const uint8_t* colorBlock = format == BlockFormat::BC3 ? block + 8 : block;
+
+	uint16_t packed0 = (uint16_t)(colorBlock[0] | (colorBlock[1] << 8));
+	uint16_t packed1 = (uint16_t)(colorBlock[2] | (colorBlock[3] << 8));
+	uint32_t colorIndices;
+	memcpy(&colorIndices, colorBlock + 4, 4);
+
+	uint32_t palette[4][4];
+	colorPalette(packed0, packed1, format == BlockFormat::BC3 || packed0 > packed1, palette);
+
+	for (int i = 0; i < 16; i++) {
+		uint32_t index = (colorIndices >> (i * 2)) & 3;
+		for (int c = 0; c < 4; c++) {
+			pixels[i * 4 + c] = (uint8_t)palette[index][c];
+		}
+	}
+
+	if (format == BlockFormat::BC3) {
+		uint32_t alphas[8];
+		alphaPalette(block[0], block[1], alphas);
+
+		uint64_t alphaIndices = 0;
+		for (int i = 0; i < 6; i++) {
+			alphaIndices |= (uint64_t)block[2 + i] << (i * 8);
+		}
+
+		for (int i = 0; i < 16; i++) {
+			pixels[i * 4 + 3] = (uint8_t)alphas[(alphaIndices >> (i * 3)) & 7];
+		}
+	}
+}
+
+void TextureCompressReport::print(const std::string& path) const
+{
+	std::cout << std::fixed << std::setprecision(2)
+		<< path << ": " << TextureCompressor::formatName(format) << " " << uncompressedBytes / (1024.0 * 1024.0) << " MiB -> "
+		<< compressedBytes / (1024.0 * 1024.0) << " MiB in " << milliseconds << " ms, PSNR " << psnr << " dB" << std::endl;
+	std::cout.unsetf(std::ios::floatfield);
+}
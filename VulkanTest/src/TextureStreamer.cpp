@@ -0,0 +1,196 @@
+#include "TextureStreamer.h"
+#include "Profiler.h"
+#include "Utils.h"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include <stb_image.h>
+
+static BlockFormat chooseBlockFormat(TextureCompression compression, bool hasAlpha)
+{
+	switch (compression) {
+	case TextureCompression::BC1:
+		return BlockFormat::BC1;
+	case TextureCompression::BC3:
+		return BlockFormat::BC3;
+	case TextureCompression::BC7:
+		return BlockFormat::BC7;
+	default:
+		return hasAlpha ? BlockFormat::BC7 : BlockFormat::BC1;
+	}
+}
+
+TextureStreamer::TextureStreamer() :
+	loading(false),
+	loaded(false),
+	cached(false)
+{
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	// The pool task writes into this object, it has to finish first
+	wait();
+}
+
+void TextureStreamer::load(const std::string& path, TextureCompression compression)
+{
+	PROFILE_SCOPE("TextureStreamer::load");
+
+	MappedFile source;
+	if (!source.open(path)) {
+		throw std::runtime_error("failed to load texture image!");
+	}
+
+	uint64_t sourceHash = Utils::hashBytes(source.data(), source.size());
+	uint64_t sourceSize = source.size();
+
+	std::string cachePath = path + ".ktx";
+	uint32_t importFlags = (uint32_t)compression;
+
+	if (compression != TextureCompression::None && cache.open(cachePath, sourceHash, sourceSize, importFlags)) {
+		const CompressedTexture& texture = cache.texture();
+		textureMips.format = blockFormatToVk(texture.format);
+		textureMips.width = texture.width;
+		textureMips.height = texture.height;
+		textureMips.levels = texture.levels;
+		textureMips.data = texture.data;
+		cached = true;
+		return;
+	}
+
+	int texWidth, texHeight, texChannels;
+	stbi_uc* pixels = stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(source.data()), (int)source.size(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+
+	if (!pixels) {
+		throw std::runtime_error("failed to load texture image!");
+	}
+
+	source.close();
+
+	uint32_t levelCount = MipChain::levelCount(texWidth, texHeight);
+	std::vector<MipLevel> levels = MipChain::layout(texWidth, texHeight, levelCount);
+
+	std::vector<uint8_t> chain(levels.back().offset + levels.back().size);
+	memcpy(chain.data(), pixels, levels[0].size);
+
+	stbi_image_free(pixels);
+
+	MipChain::generate(chain.data(), levels);
+
+	textureMips.width = texWidth;
+	textureMips.height = texHeight;
+	cached = false;
+
+	if (compression == TextureCompression::None) {
+		storage.swap(chain);
+		textureMips.format = VK_FORMAT_R8G8B8A8_UNORM;
+		textureMips.levels = levels;
+		textureMips.data = storage.data();
+		return;
+	}
+
+	CompressedTexture texture;
+	texture.format = chooseBlockFormat(compression, TextureCompressor::hasAlpha(chain.data(), (size_t)texWidth * texHeight));
+	texture.width = texWidth;
+	texture.height = texHeight;
+	texture.levels = TextureCompressor::layout(texWidth, texHeight, levelCount, texture.format);
+
+	storage.resize(texture.levels.back().offset + texture.levels.back().size);
+	texture.data = storage.data();
+
+	auto compressStart = std::chrono::steady_clock::now();
+
+	for (uint32_t i = 0; i < levelCount; i++) {
+		TextureCompressor::compress(chain.data() + levels[i].offset, levels[i].width, levels[i].height, texture.format, storage.data() + texture.levels[i].offset, ThreadPool::shared());
+	}
+
+	TextureCompressReport report;
+	report.format = texture.format;
+	report.uncompressedBytes = chain.size();
+	report.compressedBytes = storage.size();
+	report.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - compressStart).count();
+	report.psnr = TextureCompressor::psnr(chain.data(), texWidth, texHeight, texture.format, storage.data());
+	report.print(path);
+
+	if (!TextureCache::write(cachePath, sourceHash, sourceSize, importFlags, texture)) {
+		std::cerr << "failed to write texture cache " << cachePath << std::endl;
+	}
+
+	textureMips.format = blockFormatToVk(texture.format);
+	textureMips.levels = texture.levels;
+	textureMips.data = storage.data();
+}
+
+void TextureStreamer::loadAsync(const std::string& path, TextureCompression compression, ThreadPool& pool)
+{
+	wait();
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		loading = true;
+		loaded = false;
+		error = nullptr;
+	}
+
+	pool.enqueue([this, path, compression]() {
+		std::exception_ptr loadError;
+		try {
+			load(path, compression);
+		}
+		catch (...) {
+			loadError = std::current_exception();
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		loading = false;
+		loaded = !loadError;
+		error = loadError;
+		loadFinished.notify_all();
+	});
+}
+
+bool TextureStreamer::isLoaded()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (error) {
+		std::exception_ptr loadError = error;
+		error = nullptr;
+		std::rethrow_exception(loadError);
+	}
+
+	return loaded;
+}
+
+void TextureStreamer::release()
+{
+	wait();
+
+	std::lock_guard<std::mutex> lock(mutex);
+	cache.close();
+	std::vector<uint8_t>().swap(storage);
+	textureMips = TextureMips();
+	loaded = false;
+}
+
+void TextureStreamer::wait()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	loadFinished.wait(lock, [this]() { return !loading; });
+}
+
+VkFormat TextureStreamer::blockFormatToVk(BlockFormat format)
+{
+	switch (format) {
+	case BlockFormat::BC1:
+		return VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+	case BlockFormat::BC3:
+		return VK_FORMAT_BC3_UNORM_BLOCK;
+	case BlockFormat::BC7:
+		return VK_FORMAT_BC7_UNORM_BLOCK;
+	}
+	return VK_FORMAT_UNDEFINED;
+}
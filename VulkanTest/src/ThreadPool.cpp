@@ -0,0 +1,119 @@
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+
+ThreadPool::ThreadPool(uint32_t threadCount) :
+	stopping(false)
+{
+	if (threadCount == 0) {
+		uint32_t hardwareThreads = std::thread::hardware_concurrency();
+		threadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+	}
+
+	for (uint32_t i = 0; i < threadCount; i++) {
+		workers.emplace_back(&ThreadPool::workerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	taskAvailable.notify_all();
+
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+}
+
+ThreadPool& ThreadPool::shared()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+void ThreadPool::enqueue(std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		tasks.push_back(std::move(task));
+	}
+	taskAvailable.notify_one();
+}
+
+void ThreadPool::parallelFor(uint32_t count, const std::function<void(uint32_t)>& body)
+{
+	if (count == 0) {
+		return;
+	}
+
+	struct Job {
+		std::atomic<uint32_t> next;
+		std::atomic<uint32_t> finished;
+		std::mutex mutex;
+		std::condition_variable done;
+		std::exception_ptr error;
+	};
+
+	std::shared_ptr<Job> job = std::make_shared<Job>();
+	job->next = 0;
+	job->finished = 0;
+
+	// Indices are claimed dynamically, so a helper that starts late just finds nothing left to do
+	auto run = [job, count, &body]() {
+		for (uint32_t i = job->next++; i < count; i = job->next++) {
+			try {
+				body(i);
+			}
+			catch (...) {
+				std::lock_guard<std::mutex> lock(job->mutex);
+				if (!job->error) {
+					job->error = std::current_exception();
+				}
+			}
+
+			if (++job->finished == count) {
+				std::lock_guard<std::mutex> lock(job->mutex);
+				job->done.notify_all();
+			}
+		}
+	};
+
+	uint32_t helpers = std::min(count - 1, size());
+	for (uint32_t i = 0; i < helpers; i++) {
+		enqueue(run);
+	}
+
+	run();
+
+	std::unique_lock<std::mutex> lock(job->mutex);
+	job->done.wait(lock, [&job, count]() { return job->finished == count; });
+
+	if (job->error) {
+		std::rethrow_exception(job->error);
+	}
+}
+
+void ThreadPool::workerLoop()
+{
+	for (;;) {
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			taskAvailable.wait(lock, [this]() { return stopping || !tasks.empty(); });
+
+			if (stopping && tasks.empty()) {
+				return;
+			}
+
+			task = std::move(tasks.front());
+			tasks.pop_front();
+		}
+
+		task();
+	}
+}
@@ -0,0 +1,452 @@
+#include "UploadBatcher.h"
+#include "Profiler.h"
+#include <limits>
+#include <stdexcept>
+
+// Everything that reads uploaded data, including blits that build on copied images
+static const VkAccessFlags UPLOAD_READ_ACCESS = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_INDEX_READ_BIT |
+	VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+static const VkPipelineStageFlags UPLOAD_READ_STAGES = VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+	VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+UploadBatcher::UploadBatcher(const VDeleter<VkDevice>& device, MemoryAllocator& allocator) :
+	device(device),
+	allocator(allocator),
+	queue(VK_NULL_HANDLE),
+	transferQueue(VK_NULL_HANDLE),
+	queueFamilyIndex(0),
+	transferFamilyIndex(0),
+	commandPool(device, vkDestroyCommandPool),
+	transferCommandPool(device, vkDestroyCommandPool),
+	recording(),
+	isRecording(false),
+	isTransferRecording(false),
+	lastSubmitted(0),
+	lastCompleted(0)
+{
+}
+
+UploadBatcher::~UploadBatcher()
+{
+	destroy();
+}
+
+void UploadBatcher::init(VkQueue queue, uint32_t queueFamilyIndex, VkQueue transferQueue, uint32_t transferFamilyIndex)
+{
+	this->queue = queue;
+	this->queueFamilyIndex = queueFamilyIndex;
+
+	// A transfer queue from the graphics family gains nothing over recording with the graphics commands
+	this->transferQueue = transferFamilyIndex != queueFamilyIndex ? transferQueue : queue;
+	this->transferFamilyIndex = transferFamilyIndex != queueFamilyIndex ? transferFamilyIndex : queueFamilyIndex;
+
+	VkCommandPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.queueFamilyIndex = queueFamilyIndex;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+	if (vkCreateCommandPool(device, &poolInfo, nullptr, commandPool.replace()) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create upload command pool!");
+	}
+
+	if (hasTransferQueue()) {
+		poolInfo.queueFamilyIndex = this->transferFamilyIndex;
+
+		if (vkCreateCommandPool(device, &poolInfo, nullptr, transferCommandPool.replace()) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create transfer command pool!");
+		}
+	}
+}
+
+void UploadBatcher::destroy()
+{
+	if (queue == VK_NULL_HANDLE) {
+		return;
+	}
+
+	submit();
+	collect(true, lastSubmitted);
+
+	for (VkFence fence : freeFences) {
+		vkDestroyFence(device, fence, nullptr);
+	}
+	freeFences.clear();
+	for (VkSemaphore semaphore : freeSemaphores) {
+		vkDestroySemaphore(device, semaphore, nullptr);
+	}
+	freeSemaphores.clear();
+	freeCommandBuffers.clear();
+	freeTransferCommandBuffers.clear();
+
+	commandPool = VK_NULL_HANDLE;
+	transferCommandPool = VK_NULL_HANDLE;
+	queue = VK_NULL_HANDLE;
+	transferQueue = VK_NULL_HANDLE;
+}
+
+VkCommandBuffer UploadBatcher::begin(VkCommandPool pool, std::vector<VkCommandBuffer>& freeList)
+{
+	if (freeList.empty()) {
+		VkCommandBufferAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandPool = pool;
+		allocInfo.commandBufferCount = 1;
+
+		VkCommandBuffer commandBuffer;
+		if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate upload command buffer!");
+		}
+		freeList.push_back(commandBuffer);
+	}
+
+	VkCommandBuffer commandBuffer = freeList.back();
+	freeList.pop_back();
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+	return commandBuffer;
+}
+
+VkCommandBuffer UploadBatcher::record()
+{
+	if (!isRecording) {
+		recording.commandBuffer = begin(commandPool, freeCommandBuffers);
+		isRecording = true;
+	}
+
+	return recording.commandBuffer;
+}
+
+VkCommandBuffer UploadBatcher::recordTransfer()
+{
+	if (!hasTransferQueue()) {
+		return record();
+	}
+
+	if (!isTransferRecording) {
+		recording.transferCommandBuffer = begin(transferCommandPool, freeTransferCommandBuffers);
+		isTransferRecording = true;
+	}
+
+	return recording.transferCommandBuffer;
+}
+
+void UploadBatcher::transferOwnership(VkBuffer buffer)
+{
+	// Covered by the barrier that ends the batch
+	if (!hasTransferQueue()) {
+		return;
+	}
+
+	VkBufferMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = 0;
+	barrier.srcQueueFamilyIndex = transferFamilyIndex;
+	barrier.dstQueueFamilyIndex = queueFamilyIndex;
+	barrier.buffer = buffer;
+	barrier.offset = 0;
+	barrier.size = VK_WHOLE_SIZE;
+
+	vkCmdPipelineBarrier(recordTransfer(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+	// The matching acquire, recorded ahead of the batch's graphics commands once the copies are done
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = UPLOAD_READ_ACCESS;
+	recording.bufferAcquires.push_back(barrier);
+}
+
+void UploadBatcher::transferOwnership(VkImage image, const VkImageSubresourceRange& range, VkImageLayout oldLayout, VkImageLayout newLayout)
+{
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.oldLayout = oldLayout;
+	barrier.newLayout = newLayout;
+	barrier.image = image;
+	barrier.subresourceRange = range;
+
+	if (!hasTransferQueue()) {
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = UPLOAD_READ_ACCESS;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+
+		vkCmdPipelineBarrier(record(), VK_PIPELINE_STAGE_TRANSFER_BIT, UPLOAD_READ_STAGES, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+		return;
+	}
+
+	// Both halves name the same layouts, the transition happens once between them
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = 0;
+	barrier.srcQueueFamilyIndex = transferFamilyIndex;
+	barrier.dstQueueFamilyIndex = queueFamilyIndex;
+
+	vkCmdPipelineBarrier(recordTransfer(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = UPLOAD_READ_ACCESS;
+	recording.imageAcquires.push_back(barrier);
+}
+
+void UploadBatcher::retain(VDeleter<VkBuffer>& buffer, VAllocation& memory)
+{
+	recording.retained.push_back({ buffer.release(), VK_NULL_HANDLE, memory.release() });
+}
+
+void UploadBatcher::retain(VDeleter<VkImage>& image, VAllocation& memory)
+{
+	recording.retained.push_back({ VK_NULL_HANDLE, image.release(), memory.release() });
+}
+
+VkFence UploadBatcher::takeFence()
+{
+	if (freeFences.empty()) {
+		VkFenceCreateInfo fenceInfo = {};
+		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+		VkFence fence;
+		if (vkCreateFence(device, &fenceInfo, nullptr, &fence) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create upload fence!");
+		}
+		freeFences.push_back(fence);
+	}
+
+	VkFence fence = freeFences.back();
+	freeFences.pop_back();
+	return fence;
+}
+
+UploadTicket UploadBatcher::submit()
+{
+	PROFILE_SCOPE("UploadBatcher::submit");
+
+	if (!isRecording && !isTransferRecording && recording.retained.empty()) {
+		collect(false, lastSubmitted);
+		return lastSubmitted;
+	}
+
+	if (isRecording) {
+		// Make the transfer writes visible to whatever reads them in later submissions
+		VkMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+
+		vkCmdPipelineBarrier(
+			recording.commandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0,
+			1, &barrier,
+			0, nullptr,
+			0, nullptr
+		);
+
+		if (vkEndCommandBuffer(recording.commandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("failed to record upload command buffer!");
+		}
+	}
+
+	recording.fence = takeFence();
+	recording.ticket = ++lastSubmitted;
+	recording.submitted = false;
+
+	if (isTransferRecording) {
+		if (vkEndCommandBuffer(recording.transferCommandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("failed to record transfer command buffer!");
+		}
+
+		if (freeSemaphores.empty()) {
+			VkSemaphoreCreateInfo semaphoreInfo = {};
+			semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+			VkSemaphore semaphore;
+			if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS) {
+				throw std::runtime_error("failed to create transfer semaphore!");
+			}
+			freeSemaphores.push_back(semaphore);
+		}
+
+		recording.transferSemaphore = freeSemaphores.back();
+		freeSemaphores.pop_back();
+		recording.transferFence = takeFence();
+
+		VkSubmitInfo submitInfo = {};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &recording.transferCommandBuffer;
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &recording.transferSemaphore;
+
+		if (vkQueueSubmit(transferQueue, 1, &submitInfo, recording.transferFence) != VK_SUCCESS) {
+			throw std::runtime_error("failed to submit transfer command buffer!");
+		}
+	}
+
+	pending.push_back(recording);
+	recording = Batch();
+	isRecording = false;
+	isTransferRecording = false;
+
+	// Submits the graphics half right away when there was nothing to wait for
+	collect(false, lastSubmitted);
+
+	return lastSubmitted;
+}
+
+void UploadBatcher::submitGraphics(Batch& batch)
+{
+	VkCommandBuffer commandBuffers[2];
+	uint32_t commandBufferCount = 0;
+
+	if (!batch.bufferAcquires.empty() || !batch.imageAcquires.empty()) {
+		batch.acquireCommandBuffer = begin(commandPool, freeCommandBuffers);
+
+		vkCmdPipelineBarrier(
+			batch.acquireCommandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, UPLOAD_READ_STAGES,
+			0,
+			0, nullptr,
+			(uint32_t)batch.bufferAcquires.size(), batch.bufferAcquires.data(),
+			(uint32_t)batch.imageAcquires.size(), batch.imageAcquires.data()
+		);
+
+		if (vkEndCommandBuffer(batch.acquireCommandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("failed to record acquire command buffer!");
+		}
+
+		commandBuffers[commandBufferCount++] = batch.acquireCommandBuffer;
+	}
+
+	if (batch.commandBuffer != VK_NULL_HANDLE) {
+		commandBuffers[commandBufferCount++] = batch.commandBuffer;
+	}
+
+	// Already signaled by now, the wait only orders the acquires after the releases
+	VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	if (batch.transferSemaphore != VK_NULL_HANDLE) {
+		submitInfo.waitSemaphoreCount = 1;
+		submitInfo.pWaitSemaphores = &batch.transferSemaphore;
+		submitInfo.pWaitDstStageMask = &waitStage;
+	}
+	submitInfo.commandBufferCount = commandBufferCount;
+	submitInfo.pCommandBuffers = commandBuffers;
+
+	if (vkQueueSubmit(queue, 1, &submitInfo, batch.fence) != VK_SUCCESS) {
+		throw std::runtime_error("failed to submit upload command buffer!");
+	}
+
+	batch.submitted = true;
+}
+
+bool UploadBatcher::isComplete(UploadTicket ticket)
+{
+	collect(false, ticket);
+	return ticket <= lastCompleted;
+}
+
+void UploadBatcher::wait(UploadTicket ticket)
+{
+	if (ticket > lastSubmitted) {
+		throw std::invalid_argument("waiting on an upload that was never submitted!");
+	}
+	collect(true, ticket);
+}
+
+void UploadBatcher::flush()
+{
+	wait(submit());
+}
+
+void UploadBatcher::collect(bool block, UploadTicket upTo)
+{
+	// Graphics halves that acquire copies go out in ticket order, each once its copies have finished.
+	// Submitting one earlier would stall every frame queued behind its acquire barriers. Batches
+	// without copies don't wait for them, so a layout transition isn't held back by a streamed texture.
+	bool transferPending = false;
+	for (Batch& batch : pending) {
+		if (batch.submitted) {
+			continue;
+		}
+
+		if (batch.transferFence != VK_NULL_HANDLE) {
+			if (transferPending) {
+				continue;
+			}
+
+			if (block && batch.ticket <= upTo) {
+				vkWaitForFences(device, 1, &batch.transferFence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+			}
+			else if (vkGetFenceStatus(device, batch.transferFence) != VK_SUCCESS) {
+				transferPending = true;
+				continue;
+			}
+		}
+
+		submitGraphics(batch);
+	}
+
+	while (!pending.empty()) {
+		Batch& batch = pending.front();
+
+		if (!batch.submitted) {
+			break;
+		}
+
+		if (block && batch.ticket <= upTo) {
+			vkWaitForFences(device, 1, &batch.fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+		}
+		else if (vkGetFenceStatus(device, batch.fence) != VK_SUCCESS) {
+			break;
+		}
+
+		retire(batch);
+		pending.pop_front();
+	}
+}
+
+void UploadBatcher::retire(Batch& batch)
+{
+	for (Retained& retained : batch.retained) {
+		if (retained.buffer != VK_NULL_HANDLE) {
+			vkDestroyBuffer(device, retained.buffer, nullptr);
+		}
+		if (retained.image != VK_NULL_HANDLE) {
+			vkDestroyImage(device, retained.image, nullptr);
+		}
+		allocator.free(retained.memory);
+	}
+
+	vkResetFences(device, 1, &batch.fence);
+	freeFences.push_back(batch.fence);
+
+	if (batch.commandBuffer != VK_NULL_HANDLE) {
+		vkResetCommandBuffer(batch.commandBuffer, 0);
+		freeCommandBuffers.push_back(batch.commandBuffer);
+	}
+
+	if (batch.acquireCommandBuffer != VK_NULL_HANDLE) {
+		vkResetCommandBuffer(batch.acquireCommandBuffer, 0);
+		freeCommandBuffers.push_back(batch.acquireCommandBuffer);
+	}
+
+	// The graphics half waited on the transfer half, so it is done with as well
+	if (batch.transferCommandBuffer != VK_NULL_HANDLE) {
+		vkResetCommandBuffer(batch.transferCommandBuffer, 0);
+		freeTransferCommandBuffers.push_back(batch.transferCommandBuffer);
+
+		vkResetFences(device, 1, &batch.transferFence);
+		freeFences.push_back(batch.transferFence);
+
+		freeSemaphores.push_back(batch.transferSemaphore);
+	}
+
+	lastCompleted = batch.ticket;
+}
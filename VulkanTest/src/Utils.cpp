@@ -4,6 +4,7 @@
 #include <iostream>
 #include <string>
 #include <sstream>
+#include <cstring>
 
 std::vector<char> Utils::readFile(const std::string& filename)
 {
@@ -24,6 +25,49 @@ std::vector<char> Utils::readFile(const std::string& filename)
 	return buffer;
 }
 
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t mix64(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ull;
+	h ^= h >> 33;
+	return h;
+}
+
+uint64_t Utils::hashBytes(const void* data, size_t size)
+{
+	// Four independent 64-bit lanes so the multiplies pipeline, fast enough to hash large assets on every launch
+	const uint64_t prime1 = 0x9e3779b185ebca87ull;
+	const uint64_t prime2 = 0xc2b2ae3d27d4eb4full;
+
+	const char* bytes = static_cast<const char*>(data);
+	uint64_t lanes[4] = { prime1 + prime2, prime2, 0, 0 - prime1 };
+
+	size_t i = 0;
+	for (; i + 32 <= size; i += 32) {
+		for (int lane = 0; lane < 4; lane++) {
+			uint64_t word;
+			memcpy(&word, bytes + i + lane * 8, 8);
+			lanes[lane] = rotl64(lanes[lane] + word * prime2, 31) * prime1;
+		}
+	}
+
+	uint64_t h = rotl64(lanes[0], 1) + rotl64(lanes[1], 7) + rotl64(lanes[2], 12) + rotl64(lanes[3], 18);
+	h += (uint64_t)size;
+
+	for (; i < size; i++) {
+		h = rotl64(h ^ ((uint8_t)bytes[i] * prime1), 11) * prime2;
+	}
+
+	return mix64(h);
+}
+
 double Utils::calcFPS(GLFWwindow* window, bool lastFrameDrawn, double theTimeInterval, std::string theWindowTitle)
 {
 	// Static values which only get initialised the first time the function runs
@@ -0,0 +1,138 @@
+#include "VertexQuantizer.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+
+static float snorm16ToFloat(int16_t value)
+{
+	return std::max(value / 32767.0f, -1.0f);
+}
+
+static glm::vec2 octahedralEncode(const glm::vec3& n)
+{
+	glm::vec3 v = n / (std::abs(n.x) + std::abs(n.y) + std::abs(n.z));
+	glm::vec2 e(v.x, v.y);
+
+	// The lower hemisphere folds over the diagonals into the corners of the square
+	if (v.z < 0.0f) {
+		e = glm::vec2(
+			(1.0f - std::abs(v.y)) * (v.x >= 0.0f ? 1.0f : -1.0f),
+			(1.0f - std::abs(v.x)) * (v.y >= 0.0f ? 1.0f : -1.0f));
+	}
+	return e;
+}
+
+static glm::vec3 octahedralDecode(const glm::vec2& e)
+{
+	glm::vec3 n(e.x, e.y, 1.0f - std::abs(e.x) - std::abs(e.y));
+	if (n.z < 0.0f) {
+		float x = n.x;
+		n.x = (1.0f - std::abs(n.y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		n.y = (1.0f - std::abs(x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+	}
+	return glm::normalize(n);
+}
+
+void VertexQuantizer::quantize(const MeshView& mesh, PackedVertex* out, QuantizationReport& report)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	glm::vec3 scale = glm::vec3(positionScale(mesh.bounds));
+	glm::vec3 offset = glm::vec3(positionOffset(mesh.bounds));
+
+	report = QuantizationReport();
+	report.floatBytes = mesh.vertexCount * sizeof(Vertex);
+	report.packedBytes = mesh.vertexCount * sizeof(PackedVertex);
+
+	for (size_t i = 0; i < mesh.vertexCount; i++) {
+		const Vertex& v = mesh.vertices[i];
+		PackedVertex& p = out[i];
+
+		for (int c = 0; c < 3; c++) {
+			float unorm = scale[c] > 0.0f ? (v.pos[c] - offset[c]) / scale[c] : 0.0f;
+			p.pos[c] = (uint16_t)std::lround(glm::clamp(unorm, 0.0f, 1.0f) * 65535.0f);
+		}
+		p.pos[3] = 0;
+
+		encodeNormal(v.normal, p.normal);
+
+		uint32_t halves = glm::packHalf2x16(v.texCoord);
+		p.texCoord[0] = (uint16_t)(halves & 0xffff);
+		p.texCoord[1] = (uint16_t)(halves >> 16);
+
+		// Decode the way the shader does and keep the worst case of each attribute
+		glm::vec3 pos = offset + glm::vec3(p.pos[0], p.pos[1], p.pos[2]) / 65535.0f * scale;
+		report.maxPositionError = std::max(report.maxPositionError, glm::length(pos - v.pos));
+
+		float normalLength = glm::length(v.normal);
+		if (normalLength > 0.0f) {
+			float cosine = glm::clamp(glm::dot(decodeNormal(p.normal), v.normal / normalLength), -1.0f, 1.0f);
+			report.maxNormalErrorDegrees = std::max(report.maxNormalErrorDegrees, glm::degrees(std::acos(cosine)));
+		}
+
+		glm::vec2 texCoord = glm::unpackHalf2x16(halves);
+		report.maxTexCoordError = std::max(report.maxTexCoordError, glm::length(texCoord - v.texCoord));
+	}
+
+	report.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+glm::vec4 VertexQuantizer::positionScale(const Bounds& bounds)
+{
+	return glm::vec4(bounds.max - bounds.min, 0.0f);
+}
+
+glm::vec4 VertexQuantizer::positionOffset(const Bounds& bounds)
+{
+	return glm::vec4(bounds.min, 0.0f);
+}
+
+void VertexQuantizer::encodeNormal(const glm::vec3& normal, int16_t encoded[2])
+{
+	float length = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+	if (length == 0.0f) {
+		encoded[0] = 0;
+		encoded[1] = 0;
+		return;
+	}
+
+	glm::vec3 n = glm::normalize(normal);
+	glm::vec2 e = octahedralEncode(n) * 32767.0f;
+
+	// Plain rounding can be off by more than a step once decoded, try the four neighbours
+	float bestError = -2.0f;
+	for (int dy = 0; dy < 2; dy++) {
+		for (int dx = 0; dx < 2; dx++) {
+			int16_t candidate[2] = {
+				(int16_t)glm::clamp(std::floor(e.x) + dx, -32767.0f, 32767.0f),
+				(int16_t)glm::clamp(std::floor(e.y) + dy, -32767.0f, 32767.0f)
+			};
+
+			float error = glm::dot(decodeNormal(candidate), n);
+			if (error > bestError) {
+				bestError = error;
+				encoded[0] = candidate[0];
+				encoded[1] = candidate[1];
+			}
+		}
+	}
+}
+
+glm::vec3 VertexQuantizer::decodeNormal(const int16_t encoded[2])
+{
+	return octahedralDecode(glm::vec2(snorm16ToFloat(encoded[0]), snorm16ToFloat(encoded[1])));
+}
+
+void QuantizationReport::print(const std::string& path, const Bounds& bounds) const
+{
+	float diagonal = glm::length(bounds.max - bounds.min);
+
+	std::cout << std::fixed << std::setprecision(2)
+		<< path << ": packed vertices " << floatBytes / 1024.0 << " KiB -> " << packedBytes / 1024.0 << " KiB in " << milliseconds << " ms"
+		<< std::scientific << std::setprecision(3)
+		<< ", max error: position " << maxPositionError << " (" << (diagonal > 0.0f ? maxPositionError / diagonal : 0.0f) << " of the bounds diagonal)"
+		<< ", normal " << maxNormalErrorDegrees << " degrees, uv " << maxTexCoordError << std::endl;
+	std::cout.unsetf(std::ios::floatfield);
+}
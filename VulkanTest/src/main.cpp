@@ -1,11 +1,17 @@
 #include <iostream>
 
 #include "Application.h"
+#include "ObjBenchmark.h"
 
-int main() {
-	Application app;
-
+int main(int argc, char* argv[]) {
 	try {
+		AppConfig config = AppConfig::fromCommandLine(argc, argv);
+
+		if (config.objBenchmark) {
+			return ObjBenchmark::run(config.objBenchmarkMegabytes) ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+
+		Application app(config);
 		app.run();
 	}
 	catch (const std::runtime_error& e) {